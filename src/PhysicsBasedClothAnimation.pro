@@ -23,6 +23,17 @@ DEFINES += PROJECT_PATH=\"\\\"$${_PRO_FILE_PWD_}/\\\"\"
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# The solver uses OpenMP to run independent parts of a step in parallel.
+msvc {
+    QMAKE_CXXFLAGS += -openmp
+} else {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+    # Without errno and floating point traps the compiler can turn the square
+    # roots and the selects of the collider loops into vector instructions.
+    QMAKE_CXXFLAGS += -fno-math-errno -fno-trapping-math
+}
+
 FORMS += \
     mainwindow.ui
 
@@ -31,20 +42,50 @@ DISTFILES += \
     fragmentshader.glsl
 
 HEADERS += \
+    mesh/aerodynamics.h \
     mesh/bar.h \
+    mesh/barsystem.h \
+    mesh/chebyshev.h \
+    mesh/colliders.h \
+    mesh/continuouscollision.h \
+    mesh/distancefield.h \
+    mesh/embedding.h \
+    mesh/forcefield.h \
     mesh/genericmesh.h \
+    mesh/implicitsolver.h \
     mesh/mesh.h \
     mesh/particle.h \
+    mesh/projectivedynamics.h \
     mesh/rectangularmesh.h \
+    mesh/scene.h \
+    mesh/selfcollision.h \
+    mesh/sparsecholesky.h \
+    mesh/springsolver.h \
+    mesh/trianglecollider.h \
     renderwidget.h \
     mainwindow.h
 
 SOURCES += \
+    mesh/aerodynamics.cpp \
     mesh/bar.cpp \
+    mesh/barsystem.cpp \
+    mesh/chebyshev.cpp \
+    mesh/colliders.cpp \
+    mesh/continuouscollision.cpp \
+    mesh/distancefield.cpp \
+    mesh/embedding.cpp \
+    mesh/forcefield.cpp \
     mesh/genericmesh.cpp \
+    mesh/implicitsolver.cpp \
     mesh/mesh.cpp \
     mesh/particle.cpp \
+    mesh/projectivedynamics.cpp \
     mesh/rectangularmesh.cpp \
+    mesh/scene.cpp \
+    mesh/selfcollision.cpp \
+    mesh/sparsecholesky.cpp \
+    mesh/springsolver.cpp \
+    mesh/trianglecollider.cpp \
     renderwidget.cpp \
     mainwindow.cpp \
     main.cpp
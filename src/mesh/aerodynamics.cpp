@@ -0,0 +1,95 @@
+#include "aerodynamics.h"
+#include <algorithm>
+#include <cmath>
+
+// Constructor responsible for creating a disabled stage.
+Aerodynamics::Aerodynamics() : density(0.0f), drag(0.0f), lift(0.0f), airVelocity(0.0f) { }
+
+// Whether the stage should be used.
+bool Aerodynamics::enabled() {
+    return density > 0.0f && (drag > 0.0f || lift > 0.0f);
+}
+
+// Adds the aerodynamic force of every particle to forces. The velocities
+// and normals of the triangles are first gathered into arrays, the forces
+// are then computed from them with selects instead of branches, so the loop
+// is vectorized over the triangles, and every particle finally gathers the
+// forces of its own triangles, so nothing is scattered and the threads never
+// write to the same particle. An unused triangle gets a zero normal, and a
+// zero normal or velocity gives a zero force. The normal is flipped to face
+// the relative velocity, so the orientation of the triangles does not matter.
+void Aerodynamics::apply(std::vector<Particle> &particles, std::vector<glm::ivec3> &triangles,
+                         std::vector<glm::vec3> &faceNormals, std::vector<int> &start, std::vector<int> &incident,
+                         float h, std::vector<glm::vec3> &forces) {
+    int count = static_cast<int>(triangles.size());
+    int size = static_cast<int>(particles.size());
+    for (auto array : {&velocityX, &velocityY, &velocityZ, &normalX, &normalY, &normalZ, &forceX, &forceY, &forceZ})
+        array->resize(count);
+    if (forces.empty())
+        forces.assign(size, glm::vec3(0.0f));
+
+    #pragma omp parallel for
+    for (int f = 0; f < count; ++f) {
+        glm::ivec3 t = triangles[f];
+        glm::vec3 v(0.0f), normal(0.0f);
+        if (t[0] >= 0) {
+            const Particle &a = particles[t[0]];
+            const Particle &b = particles[t[1]];
+            const Particle &c = particles[t[2]];
+            glm::vec3 displacement = (a.position - a.previousPosition) + (b.position - b.previousPosition)
+                                   + (c.position - c.previousPosition);
+            v = displacement / (3.0f * h) - airVelocity;
+            normal = faceNormals[f];
+        }
+        velocityX[f] = v.x;
+        velocityY[f] = v.y;
+        velocityZ[f] = v.z;
+        normalX[f] = normal.x;
+        normalY[f] = normal.y;
+        normalZ[f] = normal.z;
+    }
+
+    const float *vx = velocityX.data(), *vy = velocityY.data(), *vz = velocityZ.data();
+    const float *nx = normalX.data(), *ny = normalY.data(), *nz = normalZ.data();
+    float *fx = forceX.data(), *fy = forceY.data(), *fz = forceZ.data();
+    float pressure = 0.25f * density, dragFactor = drag, liftFactor = lift;
+#if defined(_OPENMP) && _OPENMP >= 201307
+    #pragma omp parallel for simd
+#else
+    #pragma omp parallel for
+#endif
+    for (int f = 0; f < count; ++f) {
+        float speed = std::sqrt(vx[f] * vx[f] + vy[f] * vy[f] + vz[f] * vz[f]);
+        float twiceArea = std::sqrt(nx[f] * nx[f] + ny[f] * ny[f] + nz[f] * nz[f]);
+        float speedDivisor = speed > 0.0f ? speed : 1.0f;
+        float areaDivisor = twiceArea > 0.0f ? twiceArea : 1.0f;
+        float ux = vx[f] / speedDivisor, uy = vy[f] / speedDivisor, uz = vz[f] / speedDivisor;
+        float mx = nx[f] / areaDivisor, my = ny[f] / areaDivisor, mz = nz[f] / areaDivisor;
+        float cosine = mx * ux + my * uy + mz * uz;
+        float side = cosine < 0.0f ? -1.0f : 1.0f;
+        mx *= side;
+        my *= side;
+        mz *= side;
+        cosine *= side;
+
+        float q = pressure * speed * speed * twiceArea;
+        float pull = -(q * dragFactor * cosine);
+        float ax = cosine * ux - mx, ay = cosine * uy - my, az = cosine * uz - mz;
+        float length = std::sqrt(ax * ax + ay * ay + az * az);
+        float push = q * liftFactor * cosine * std::sqrt(std::max(0.0f, 1.0f - cosine * cosine))
+                   / (length > 0.0f ? length : 1.0f);
+        fx[f] = (pull * ux + push * ax) / 3.0f;
+        fy[f] = (pull * uy + push * ay) / 3.0f;
+        fz[f] = (pull * uz + push * az) / 3.0f;
+    }
+
+    #pragma omp parallel for
+    for (int k = 0; k < size; ++k) {
+        glm::vec3 sum(0.0f);
+        for (int e = start[k]; e < start[k + 1]; ++e) {
+            int f = incident[e];
+            sum += glm::vec3(fx[f], fy[f], fz[f]);
+        }
+        forces[k] += sum;
+    }
+}
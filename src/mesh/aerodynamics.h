@@ -0,0 +1,48 @@
+#ifndef AERODYNAMICS_H
+#define AERODYNAMICS_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "particle.h"
+
+// Class responsible for the aerodynamic forces on the triangles of a mesh.
+// Each triangle moves through the air with the mean Verlet velocity of its
+// vertices minus the air velocity, and feels a drag opposite to that relative
+// velocity and a lift across it, both proportional to the dynamic pressure
+// and to the area the triangle shows to the flow (Keckeisen et al. 2004):
+//     drag = -q A Cd cos(t) u,  lift = q A Cl cos(t) sin(t) l,
+// with q = density |v|^2 / 2, u the direction of the relative velocity, t the
+// angle between u and the normal and l the unit vector across u in the plane
+// of u and the normal. A third of each force goes to every vertex.
+class Aerodynamics {
+    // Velocity of every triangle relative to the air, its area weighted
+    // normal and the force on each of its vertices, one array per
+    // coordinate, so the force is computed for several triangles at once.
+    std::vector<float> velocityX, velocityY, velocityZ;
+    std::vector<float> normalX, normalY, normalZ;
+    std::vector<float> forceX, forceY, forceZ;
+
+public:
+    // Density of the air, drag and lift coefficients and velocity of the
+    // air. The stage is disabled when the density is 0.
+    float density;
+    float drag;
+    float lift;
+    glm::vec3 airVelocity;
+
+    // Constructor responsible for creating a disabled stage.
+    Aerodynamics();
+
+    // Whether the stage should be used.
+    bool enabled();
+
+    // Adds the aerodynamic force of every particle to forces for a step of
+    // size h, receiving the triangles, their area weighted normals and the
+    // triangles around each particle, those of particle k being
+    // incident[start[k]] to incident[start[k + 1] - 1].
+    void apply(std::vector<Particle> &particles, std::vector<glm::ivec3> &triangles,
+               std::vector<glm::vec3> &faceNormals, std::vector<int> &start, std::vector<int> &incident,
+               float h, std::vector<glm::vec3> &forces);
+};
+
+#endif // AERODYNAMICS_H
@@ -1,23 +1,77 @@
 #include "bar.h"
 #include <glm/glm.hpp>
 
-// Builder responsible for creating the bar.
-Bar::Bar(Particle &p1, Particle &p2, float length)
-    : p1(p1), p2(p2), length(length) { }
+// Builder responsible for creating the bar between the particles
+// with the given indices.
+Bar::Bar(std::vector<Particle> &particles, int index1, int index2, float length)
+    : p1(&particles[index1]), p2(&particles[index2]),
+      index1(index1), index2(index2), length(length),
+      compliance(0.0f), lambda(0.0f) { }
 
-// Method responsible for bar relaxation.
-void Bar::update() {
-    glm::vec3 direction = p1.position - p2.position;
+// Method responsible for bar relaxation. The correction is split between
+// the two ends proportionally to their inverse masses, so a fixed particle
+// (inverse mass zero) never moves and the free end takes all of it.
+// The correction is scaled by the over-relaxation factor omega and the
+// length error found before the correction is returned.
+float Bar::update(float omega) {
+    float w1 = p1->inverseMass;
+    float w2 = p2->inverseMass;
+    float w = w1 + w2;
+    if (w == 0.0f)
+        return 0.0f;
+
+    glm::vec3 direction = p1->position - p2->position;
+    float distance = glm::length(direction);
+    float error = length - distance;
+    float adjust = omega * error / (distance * w);
+
+    p1->position += (w1 * adjust) * direction;
+    p2->position -= (w2 * adjust) * direction;
+    return glm::abs(error);
+}
+
+// Method responsible for relaxing the bar only when it is longer than its
+// length. A shorter bar is left alone, so the two ends can come closer, as
+// they do across a fold, and only their stretch is limited.
+float Bar::limit(float omega) {
+    float w1 = p1->inverseMass;
+    float w2 = p2->inverseMass;
+    float w = w1 + w2;
+    if (w == 0.0f)
+        return 0.0f;
+
+    glm::vec3 direction = p1->position - p2->position;
     float distance = glm::length(direction);
-    float adjust = length - distance;
-
-    direction /= distance;
-    if (!p1.isFixed && !p2.isFixed) {
-        p1.position += (adjust / 2.0f) * direction;
-        p2.position += (adjust / 2.0f) * (-direction);
-    } else if (!p1.isFixed) {
-        p1.position += adjust * direction;
-    } else if (!p2.isFixed) {
-        p2.position += adjust * (-direction);
-    }
+    float error = length - distance;
+    if (error >= 0.0f)
+        return 0.0f;
+    float adjust = omega * error / (distance * w);
+
+    p1->position += (w1 * adjust) * direction;
+    p2->position -= (w2 * adjust) * direction;
+    return -error;
+}
+
+// Method responsible for the XPBD projection of the bar for a substep
+// of size h. The compliance, scaled by 1/h^2, makes the bar behave as a
+// spring whose stiffness does not depend on the number of iterations.
+// Updates lambda and returns the length error found.
+float Bar::solve(float h) {
+    float w1 = p1->inverseMass;
+    float w2 = p2->inverseMass;
+    float alpha = compliance / (h * h);
+    float w = w1 + w2 + alpha;
+    if (w == 0.0f)
+        return 0.0f;
+
+    glm::vec3 direction = p1->position - p2->position;
+    float distance = glm::length(direction);
+    float error = distance - length;
+    float deltaLambda = (-error - alpha * lambda) / w;
+    lambda += deltaLambda;
+
+    direction *= deltaLambda / distance;
+    p1->position += w1 * direction;
+    p2->position -= w2 * direction;
+    return glm::abs(error);
 }
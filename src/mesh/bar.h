@@ -1,19 +1,44 @@
+#ifndef BAR_H
+#define BAR_H
+
 #include "particle.h"
 #include <glm/glm.hpp>
+#include <vector>
 
 // Class that represents the bar. Constains two particles and the
 // length of the bar (which is the distance between the particles).
 // Each particle is in one end of the bar.
 class Bar {
-    Particle &p1;
-    Particle &p2;
-    float length;
+    Particle *p1;
+    Particle *p2;
 
 public:
+    // Indices of the two particles in the particle vector of the mesh.
+    int index1, index2;
+    float length;
+
+    // Compliance (inverse stiffness) of the bar and its accumulated Lagrange
+    // multiplier, used by the XPBD solver. A compliance of 0 is a rigid bar.
+    float compliance;
+    float lambda;
 
-    // Constructor responsible for creating the bar.
-    Bar(Particle &p1, Particle &p2, float length);
+    // Constructor responsible for creating the bar between the particles
+    // with the given indices. The particle vector must not reallocate
+    // while the bar is alive.
+    Bar(std::vector<Particle> &particles, int index1, int index2, float length);
 
-    // Method responsible for bar relaxation.
-    void update();
+    // Method responsible for bar relaxation, weighted by the inverse masses.
+    // The correction is scaled by the over-relaxation factor omega and the
+    // length error found before the correction is returned.
+    float update(float omega = 1.0f);
+
+    // Method responsible for relaxing the bar only when it is longer than
+    // its length, as a limit on its stretch. Returns the excess length.
+    float limit(float omega = 1.0f);
+
+    // Method responsible for the XPBD projection of the bar for a substep
+    // of size h. Updates lambda and returns the length error found.
+    float solve(float h);
 };
+
+#endif // BAR_H
@@ -0,0 +1,179 @@
+#include "barsystem.h"
+#include <algorithm>
+
+// Constructor responsible for creating an empty system.
+BarSystem::BarSystem() : analyzedBars(-1) { }
+
+// Whether the fixed particles or the bars changed since the last analysis.
+// The endpoints are compared too, since a mesh that adapts its topology can
+// replace bars without changing their number.
+bool BarSystem::changed(std::vector<Particle> &particles, std::vector<Bar> &bars) {
+    int size = static_cast<int>(particles.size());
+    if (static_cast<int>(analyzedFixed.size()) != size || analyzedBars != static_cast<int>(bars.size()))
+        return true;
+    for (int k = 0; k < size; ++k)
+        if (analyzedFixed[k] != particles[k].isFixed)
+            return true;
+    for (int b = 0; b < analyzedBars; ++b)
+        if (jacobianColumns[2 * b] != bars[b].index1 || jacobianColumns[2 * b + 1] != bars[b].index2)
+            return true;
+    return false;
+}
+
+// Computes the incidence, the rows and the pattern of the system. Duplicated
+// bars share the same off diagonal position.
+void BarSystem::analyze(std::vector<Particle> &particles, std::vector<Bar> &bars) {
+    int size = static_cast<int>(particles.size());
+    int count = static_cast<int>(bars.size());
+
+    jacobianColumns.resize(2 * count);
+    jacobianValues.resize(2 * count);
+    lengths.resize(count);
+    for (int b = 0; b < count; ++b) {
+        jacobianColumns[2 * b] = bars[b].index1;
+        jacobianColumns[2 * b + 1] = bars[b].index2;
+    }
+
+    start.assign(size + 1, 0);
+    for (int j = 0; j < 2 * count; ++j)
+        start[jacobianColumns[j] + 1]++;
+    for (int k = 0; k < size; ++k)
+        start[k + 1] += start[k];
+    std::vector<int> next(start.begin(), start.end() - 1);
+    incident.resize(2 * count);
+    for (int j = 0; j < 2 * count; ++j)
+        incident[next[jacobianColumns[j]]++] = j;
+
+    row.assign(size, -1);
+    freeParticles.clear();
+    for (int k = 0; k < size; ++k) {
+        if (!particles[k].isFixed) {
+            row[k] = static_cast<int>(freeParticles.size());
+            freeParticles.push_back(k);
+        }
+    }
+
+    int rows = static_cast<int>(freeParticles.size());
+    rowStart.assign(1, 0);
+    columns.clear();
+    diagonal.resize(rows);
+    entry.assign(2 * count, -1);
+    std::vector<int> neighbours;
+    for (int r = 0; r < rows; ++r) {
+        int k = freeParticles[r];
+        neighbours.assign(1, r);
+        for (int e = start[k]; e < start[k + 1]; ++e) {
+            int other = row[jacobianColumns[incident[e] ^ 1]];
+            if (other >= 0)
+                neighbours.push_back(other);
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+        int offset = static_cast<int>(columns.size());
+        columns.insert(columns.end(), neighbours.begin(), neighbours.end());
+        rowStart.push_back(static_cast<int>(columns.size()));
+        diagonal[r] = offset + static_cast<int>(std::lower_bound(neighbours.begin(), neighbours.end(), r)
+                                                - neighbours.begin());
+        for (int e = start[k]; e < start[k + 1]; ++e) {
+            int other = row[jacobianColumns[incident[e] ^ 1]];
+            if (other >= 0)
+                entry[e] = offset + static_cast<int>(std::lower_bound(neighbours.begin(), neighbours.end(), other)
+                                                     - neighbours.begin());
+        }
+    }
+
+    analyzedFixed.resize(size);
+    for (int k = 0; k < size; ++k)
+        analyzedFixed[k] = particles[k].isFixed;
+    analyzedBars = count;
+}
+
+// Number of rows of the system.
+int BarSystem::size() {
+    return static_cast<int>(freeParticles.size());
+}
+
+// Fills the Jacobian and the lengths for the current positions.
+void BarSystem::fillJacobian(std::vector<Particle> &particles) {
+    int count = static_cast<int>(lengths.size());
+    #pragma omp parallel for
+    for (int b = 0; b < count; ++b) {
+        glm::vec3 d = particles[jacobianColumns[2 * b]].position - particles[jacobianColumns[2 * b + 1]].position;
+        float l = glm::length(d);
+        glm::vec3 n = d / l;
+        lengths[b] = l;
+        jacobianValues[2 * b] = n;
+        jacobianValues[2 * b + 1] = -n;
+    }
+}
+
+// Computes out = J^T lambda for the free particles. Each row gathers the
+// entries of its own bars, so no synchronization is needed.
+void BarSystem::gather(std::vector<float> &lambda, std::vector<glm::vec3> &out) {
+    int rows = size();
+    out.resize(rows);
+    #pragma omp parallel for
+    for (int r = 0; r < rows; ++r) {
+        int k = freeParticles[r];
+        glm::vec3 sum(0.0f);
+        for (int e = start[k]; e < start[k + 1]; ++e) {
+            int j = incident[e];
+            sum += lambda[j / 2] * jacobianValues[j];
+        }
+        out[r] = sum;
+    }
+}
+
+// Fills M massScale + weight L, with L the graph Laplacian of the bars.
+void BarSystem::assemble(std::vector<double> &values, std::vector<Particle> &particles,
+                         float massScale, float weight) {
+    int rows = size();
+    values.resize(columns.size());
+    #pragma omp parallel for
+    for (int r = 0; r < rows; ++r) {
+        int k = freeParticles[r];
+        for (int p = rowStart[r]; p < rowStart[r + 1]; ++p)
+            values[p] = 0.0;
+        double sum = static_cast<double>(massScale) * particles[k].mass;
+        for (int e = start[k]; e < start[k + 1]; ++e) {
+            sum += weight;
+            if (entry[e] >= 0)
+                values[entry[e]] -= weight;
+        }
+        values[diagonal[r]] += sum;
+    }
+}
+
+// Fills M massScale + scale K, with K assembled from one block per bar.
+void BarSystem::assemble(std::vector<glm::mat3> &values, std::vector<Particle> &particles,
+                         float massScale, float scale, std::vector<glm::mat3> &blocks) {
+    int rows = size();
+    values.resize(columns.size());
+    #pragma omp parallel for
+    for (int r = 0; r < rows; ++r) {
+        int k = freeParticles[r];
+        for (int p = rowStart[r]; p < rowStart[r + 1]; ++p)
+            values[p] = glm::mat3(0.0f);
+        glm::mat3 sum(massScale * particles[k].mass);
+        for (int e = start[k]; e < start[k + 1]; ++e) {
+            glm::mat3 block = scale * blocks[incident[e] / 2];
+            sum += block;
+            if (entry[e] >= 0)
+                values[entry[e]] -= block;
+        }
+        values[diagonal[r]] += sum;
+    }
+}
+
+// Computes y = A x for a block matrix with the pattern of the system.
+void BarSystem::multiply(std::vector<glm::mat3> &values, std::vector<glm::vec3> &x, std::vector<glm::vec3> &y) {
+    int rows = size();
+    #pragma omp parallel for
+    for (int r = 0; r < rows; ++r) {
+        glm::vec3 sum(0.0f);
+        for (int p = rowStart[r]; p < rowStart[r + 1]; ++p)
+            sum += values[p] * x[columns[p]];
+        y[r] = sum;
+    }
+}
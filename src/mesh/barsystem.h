@@ -0,0 +1,83 @@
+#ifndef BARSYSTEM_H
+#define BARSYSTEM_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "particle.h"
+#include "bar.h"
+
+// Class responsible for the sparse matrices of the bar constraints, shared by
+// the solvers that need them. The symbolic part (incidence of the bars, rows
+// of the free particles, pattern of the system matrix) is computed once by
+// analyze, and only the numeric values are refilled every step, in parallel
+// and without allocations.
+//
+// The Jacobian of the bar lengths is kept in compressed sparse row form with
+// exactly two entries per row: row b has entry 2b at column index1 with value
+// n and entry 2b+1 at column index2 with value -n, where n is the unit
+// direction of the bar.
+//
+// The system matrix has one row per free particle and one column for the
+// particle itself and for each free neighbour. Bars to fixed particles only
+// contribute to the diagonal.
+class BarSystem {
+    // State the pattern was computed for.
+    std::vector<bool> analyzedFixed;
+    int analyzedBars;
+
+public:
+    // Jacobian entries of each particle: the entries of particle k are
+    // incident[start[k]] to incident[start[k+1]-1]. Entry j belongs to bar
+    // j/2 and the other end of the bar is jacobianColumns[j ^ 1].
+    std::vector<int> start;
+    std::vector<int> incident;
+
+    // Row of each particle in the system, -1 for fixed particles, and the
+    // particle of each row.
+    std::vector<int> row;
+    std::vector<int> freeParticles;
+
+    // Pattern of the system matrix, the position of the diagonal of each row
+    // and the position of the off diagonal of each incident entry (-1 when
+    // the other end is fixed).
+    std::vector<int> rowStart;
+    std::vector<int> columns;
+    std::vector<int> diagonal;
+    std::vector<int> entry;
+
+    // Jacobian of the bar lengths and current length of each bar.
+    std::vector<int> jacobianColumns;
+    std::vector<glm::vec3> jacobianValues;
+    std::vector<float> lengths;
+
+    // Constructor responsible for creating an empty system.
+    BarSystem();
+
+    // Whether the fixed particles or the bars changed since the last analysis.
+    bool changed(std::vector<Particle> &particles, std::vector<Bar> &bars);
+
+    // Computes the incidence, the rows and the pattern of the system.
+    void analyze(std::vector<Particle> &particles, std::vector<Bar> &bars);
+
+    // Number of rows of the system.
+    int size();
+
+    // Fills the Jacobian and the lengths for the current positions.
+    void fillJacobian(std::vector<Particle> &particles);
+
+    // Computes out = J^T lambda for the free particles.
+    void gather(std::vector<float> &lambda, std::vector<glm::vec3> &out);
+
+    // Fills M massScale + weight L, with L the graph Laplacian of the bars.
+    void assemble(std::vector<double> &values, std::vector<Particle> &particles,
+                  float massScale, float weight);
+
+    // Fills M massScale + scale K, with K assembled from one block per bar.
+    void assemble(std::vector<glm::mat3> &values, std::vector<Particle> &particles,
+                  float massScale, float scale, std::vector<glm::mat3> &blocks);
+
+    // Computes y = A x for a block matrix with the pattern of the system.
+    void multiply(std::vector<glm::mat3> &values, std::vector<glm::vec3> &x, std::vector<glm::vec3> &y);
+};
+
+#endif // BARSYSTEM_H
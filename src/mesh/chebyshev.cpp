@@ -0,0 +1,70 @@
+#include "chebyshev.h"
+#include <algorithm>
+#include <cmath>
+
+// Constructor responsible for creating a disabled accelerator.
+Chebyshev::Chebyshev()
+    : iteration(0), omega(1.0f), lastChange(0.0), estimate(0.0f),
+      rho(0.0f), delay(3), autoTune(false) { }
+
+// Whether the acceleration should be applied.
+bool Chebyshev::enabled() {
+    return rho > 0.0f || autoTune;
+}
+
+// Prepares the accelerator for a new step of a mesh with size particles.
+// The first iterate of a step is only known after the first iteration, so
+// at least two plain iterations are needed before extrapolating.
+void Chebyshev::startStep(int size) {
+    if (static_cast<int>(current.size()) != size) {
+        previous.assign(size, glm::vec3(0.0f));
+        current.assign(size, glm::vec3(0.0f));
+    }
+    iteration = 0;
+    omega = 1.0f;
+    lastChange = 0.0;
+}
+
+// Extrapolates the count particles stored at index offset onwards after
+// a relaxation iteration. Returns the squared length of the change made
+// by the iteration itself, to be passed to finishIteration. Fixed particles
+// do not move between iterates, so the extrapolation leaves them in place.
+double Chebyshev::accelerate(Particle *particles, int count, int offset) {
+    double change = 0.0;
+    glm::vec3 *q1 = &previous[offset];
+    glm::vec3 *q = &current[offset];
+    for (int i = 0; i < count; ++i) {
+        glm::vec3 relaxed = particles[i].position;
+        glm::vec3 d = relaxed - q[i];
+        change += glm::dot(d, d);
+        glm::vec3 next = omega * (relaxed - q1[i]) + q1[i];
+        particles[i].position = next;
+        q1[i] = q[i];
+        q[i] = next;
+    }
+    return change;
+}
+
+// Closes an iteration, receiving the total squared change of the
+// particles, and computes the weight of the next one:
+// 1 during the delay, 2/(2-rho^2) right after it and 4/(4-rho^2*omega)
+// from then on. While no extrapolation is done the ratio between
+// consecutive changes measures the convergence rate of the relaxation,
+// which is what autoTune uses as rho.
+void Chebyshev::finishIteration(double change) {
+    int start = std::max(delay, 2);
+    ++iteration;
+    if (iteration >= 3 && iteration == start && lastChange > 0.0) {
+        float ratio = static_cast<float>(std::sqrt(change / lastChange));
+        estimate = estimate > 0.0f ? 0.9f * estimate + 0.1f * ratio : ratio;
+    }
+    lastChange = change;
+
+    float r = std::min(autoTune ? estimate : rho, 0.999f);
+    if (iteration < start || r <= 0.0f)
+        omega = 1.0f;
+    else if (iteration == start)
+        omega = 2.0f / (2.0f - r * r);
+    else
+        omega = 4.0f / (4.0f - r * r * omega);
+}
@@ -0,0 +1,53 @@
+#ifndef CHEBYSHEV_H
+#define CHEBYSHEV_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "particle.h"
+
+// Class responsible for the Chebyshev semi-iterative acceleration of the
+// relaxation (Wang 2015). After every relaxation iteration the positions are
+// extrapolated from the two previous iterates with a weight that follows the
+// Chebyshev recurrence for the given spectral radius. It keeps the previous
+// iterates of every particle, addressed by the index used by the mesh.
+class Chebyshev {
+    std::vector<glm::vec3> previous;
+    std::vector<glm::vec3> current;
+    int iteration;
+    float omega;
+    double lastChange;
+    float estimate;
+
+public:
+    // Estimate of the spectral radius of the relaxation. Acceleration is
+    // disabled when it is 0 and autoTune is not set.
+    float rho;
+
+    // Number of plain iterations at the start of each step before the
+    // extrapolation kicks in (at least 2, and 3 for autoTune to measure).
+    int delay;
+
+    // Whether rho is estimated from the convergence observed during the
+    // plain iterations of the previous steps.
+    bool autoTune;
+
+    // Constructor responsible for creating a disabled accelerator.
+    Chebyshev();
+
+    // Whether the acceleration should be applied.
+    bool enabled();
+
+    // Prepares the accelerator for a new step of a mesh with size particles.
+    void startStep(int size);
+
+    // Extrapolates the count particles stored at index offset onwards after
+    // a relaxation iteration. Returns the squared length of the change made
+    // by the iteration itself, to be passed to finishIteration.
+    double accelerate(Particle *particles, int count, int offset);
+
+    // Closes an iteration, receiving the total squared change of the
+    // particles, and computes the weight of the next one.
+    void finishIteration(double change);
+};
+
+#endif // CHEBYSHEV_H
@@ -0,0 +1,417 @@
+#include "colliders.h"
+#include <algorithm>
+#include <cmath>
+
+// The loops of the narrowphase are vectorized with OpenMP 4.0. Older
+// versions, like the OpenMP 2.0 of MSVC, run them as plain loops.
+#if defined(_OPENMP) && _OPENMP >= 201307
+#define SIMD_LOOP _Pragma("omp simd")
+#else
+#define SIMD_LOOP
+#endif
+
+namespace {
+
+// Number of consecutive particles that share a bounding box in the
+// broadphase.
+const int BLOCK = 64;
+
+// Moves the particle to the surface point x + depth n, where n is the unit
+// outward normal, and removes a fraction of its tangential motion when
+// friction is given.
+inline void push(Particle &p, glm::vec3 n, float depth, float friction) {
+    p.position += depth * n;
+    if (friction > 0.0f) {
+        glm::vec3 d = p.position - p.previousPosition;
+        p.position -= friction * (d - glm::dot(d, n) * n);
+    }
+}
+
+}
+
+// Constructor responsible for creating an empty set.
+Colliders::Colliders() : stale(true), thickness(0.0f) { }
+
+// Whether there is any collider.
+bool Colliders::enabled() {
+    return !shapes.empty() || !meshes.empty() || !fields.empty();
+}
+
+// Adds a sphere of the given center and radius.
+void Colliders::addSphere(glm::vec3 center, float radius, float friction) {
+    Collider c;
+    c.shape = Collider::Sphere;
+    c.center = center;
+    c.radius = radius;
+    c.friction = friction;
+    updateBounds(c);
+    shapes.push_back(c);
+}
+
+// Adds a capsule around the segment from a to b.
+void Colliders::addCapsule(glm::vec3 a, glm::vec3 b, float radius, float friction) {
+    Collider c;
+    c.shape = Collider::Capsule;
+    c.center = a;
+    c.end = b;
+    c.radius = radius;
+    c.friction = friction;
+    updateBounds(c);
+    shapes.push_back(c);
+}
+
+// Adds a box with the given half extents along the columns of rotation,
+// which must be orthonormal.
+void Colliders::addBox(glm::vec3 center, glm::vec3 halfExtents, glm::mat3 rotation, float friction) {
+    Collider c;
+    c.shape = Collider::Box;
+    c.center = center;
+    c.halfExtents = halfExtents;
+    c.rotation = rotation;
+    c.friction = friction;
+    updateBounds(c);
+    shapes.push_back(c);
+}
+
+// Adds a plane through point, the particles being kept on the side normal
+// points to.
+void Colliders::addPlane(glm::vec3 point, glm::vec3 normal, float friction) {
+    Collider c;
+    c.shape = Collider::Plane;
+    c.center = point;
+    c.normal = glm::normalize(normal);
+    c.friction = friction;
+    updateBounds(c);
+    shapes.push_back(c);
+}
+
+// Adds a triangle mesh, building its hierarchy.
+void Colliders::addMesh(const std::vector<glm::vec3> &vertices, const std::vector<glm::ivec3> &triangles,
+                        float friction) {
+    meshes.push_back(TriangleCollider(vertices, triangles, friction));
+    stale = true;
+}
+
+// Adds the triangle mesh of a Wavefront OBJ file.
+bool Colliders::loadMesh(const std::string &path, float friction) {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::ivec3> triangles;
+    if (!TriangleCollider::load(path, vertices, triangles))
+        return false;
+    addMesh(vertices, triangles, friction);
+    return true;
+}
+
+// Adds a static collider baked into a distance field.
+bool Colliders::addDistanceField(const std::vector<glm::vec3> &vertices, const std::vector<glm::ivec3> &triangles,
+                                 float cellSize, int bandCells, const std::string &cacheDirectory, float friction) {
+    DistanceField field;
+    if (!field.create(vertices, triangles, cellSize, bandCells, cacheDirectory))
+        return false;
+    field.friction = friction;
+    fields.push_back(field);
+    return true;
+}
+
+// Adds the triangle mesh of a Wavefront OBJ file as a distance field.
+bool Colliders::loadDistanceField(const std::string &path, float cellSize, int bandCells,
+                                  const std::string &cacheDirectory, float friction) {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::ivec3> triangles;
+    if (!TriangleCollider::load(path, vertices, triangles))
+        return false;
+    return addDistanceField(vertices, triangles, cellSize, bandCells, cacheDirectory, friction);
+}
+
+// Computes the bounding boxes again.
+void Colliders::updateBounds() {
+    for (auto &c : shapes)
+        updateBounds(c);
+}
+
+// Computes the bounding box of the given collider. A plane has none, the
+// broadphase tests it against the boxes of the blocks directly.
+void Colliders::updateBounds(Collider &c) {
+    switch (c.shape) {
+    case Collider::Sphere:
+        c.low = c.center - c.radius;
+        c.high = c.center + c.radius;
+        break;
+    case Collider::Capsule:
+        c.low = glm::min(c.center, c.end) - c.radius;
+        c.high = glm::max(c.center, c.end) + c.radius;
+        break;
+    case Collider::Box: {
+        glm::mat3 r = c.rotation;
+        glm::vec3 extent = glm::abs(r[0]) * c.halfExtents.x + glm::abs(r[1]) * c.halfExtents.y
+                         + glm::abs(r[2]) * c.halfExtents.z;
+        c.low = c.center - extent;
+        c.high = c.center + extent;
+        break;
+    }
+    case Collider::Plane:
+        c.low = glm::vec3(0.0f);
+        c.high = glm::vec3(0.0f);
+        break;
+    }
+}
+
+// Moves every particle inside a collider to its surface. The blocks are
+// independent, so they run in parallel, and the colliders are handled in
+// order inside each block. Fixed and sleeping particles are skipped and do
+// not count in the bounds of their block.
+int Colliders::project(std::vector<Particle> &particles, bool final) {
+    int size = static_cast<int>(particles.size());
+    int blocks = (size + BLOCK - 1) / BLOCK;
+    int count = static_cast<int>(shapes.size());
+    int contacts = 0;
+
+    #pragma omp parallel for reduction(+:contacts) schedule(dynamic, 16)
+    for (int b = 0; b < blocks; ++b) {
+        int begin = b * BLOCK;
+        int end = std::min(begin + BLOCK, size);
+        glm::vec3 low(INFINITY), high(-INFINITY);
+        for (int k = begin; k < end; ++k) {
+            if (particles[k].inverseMass == 0.0f)
+                continue;
+            low = glm::min(low, particles[k].position);
+            high = glm::max(high, particles[k].position);
+        }
+        if (low.x > high.x)
+            continue;
+        low -= thickness;
+        high += thickness;
+
+        for (int s = 0; s < count; ++s) {
+            Collider &c = shapes[s];
+            if (c.shape == Collider::Plane) {
+                glm::vec3 middle = 0.5f * (low + high);
+                glm::vec3 half = 0.5f * (high - low);
+                if (glm::dot(c.normal, middle - c.center) - glm::dot(glm::abs(c.normal), half) >= thickness)
+                    continue;
+            } else if (glm::any(glm::lessThan(high, c.low)) || glm::any(glm::greaterThan(low, c.high))) {
+                continue;
+            }
+            contacts += projectBlock(c, particles, begin, end, final);
+        }
+    }
+
+    // A particle left on the surface of a mesh by a zero thickness would
+    // lose its side to rounding, so the meshes need a positive one.
+    if (thickness > 0.0f && !meshes.empty()) {
+        bool search = stale || final;
+        candidates.resize(meshes.size());
+        for (size_t i = 0; i < meshes.size(); ++i)
+            contacts += projectMesh(meshes[i], candidates[i], particles, final, search);
+        stale = final;
+    }
+
+    for (auto &field : fields)
+        contacts += projectField(field, particles, final);
+    return contacts;
+}
+
+// Stores where the particles start the step, when there are triangle meshes.
+void Colliders::begin(std::vector<Particle> &particles) {
+    if (meshes.empty())
+        return;
+    int size = static_cast<int>(particles.size());
+    starts.resize(size);
+    #pragma omp parallel for
+    for (int k = 0; k < size; ++k)
+        starts[k] = particles[k].position;
+}
+
+// Takes the particles that crossed a triangle mesh during the step back to
+// where they hit it, thickness off its surface. The motion of the meshes is
+// then used up, so their current vertices become the previous ones.
+int Colliders::sweep(std::vector<Particle> &particles, std::vector<glm::ivec3> &triangles) {
+    int moved = 0;
+    if (continuous.enabled() && !meshes.empty() && starts.size() == particles.size())
+        moved = continuous.solve(particles, starts, triangles, meshes, thickness);
+    for (auto &mesh : meshes)
+        mesh.settle();
+    return moved;
+}
+
+// Projects the particles [begin, end) out of the given collider, keeping
+// them thickness away from its surface. The positions of the block are
+// gathered into arrays, one per coordinate, and the depth and the normal of
+// every particle are computed for the shape with selects instead of
+// branches, so the loop is vectorized over the particles. A particle that is
+// fixed, asleep or not in contact gets a depth of 0, and only the particles
+// with a positive depth are pushed back, one by one.
+int Colliders::projectBlock(Collider &c, std::vector<Particle> &particles, int begin, int end, bool final) {
+    float friction = final ? c.friction : 0.0f;
+    int count = end - begin;
+    float x[BLOCK], y[BLOCK], z[BLOCK], movable[BLOCK];
+    float depth[BLOCK], nx[BLOCK], ny[BLOCK], nz[BLOCK];
+    for (int i = 0; i < count; ++i) {
+        const Particle &p = particles[begin + i];
+        x[i] = p.position.x;
+        y[i] = p.position.y;
+        z[i] = p.position.z;
+        movable[i] = p.inverseMass;
+    }
+
+    switch (c.shape) {
+    case Collider::Sphere:
+    case Collider::Capsule: {
+        // A sphere is a capsule whose axis has no length.
+        float reach = c.radius + thickness;
+        glm::vec3 axis = c.shape == Collider::Capsule ? c.end - c.center : glm::vec3(0.0f);
+        float squaredLength = glm::dot(axis, axis);
+        float scale = squaredLength > 0.0f ? 1.0f / squaredLength : 0.0f;
+        SIMD_LOOP
+        for (int i = 0; i < count; ++i) {
+            float t = (x[i] - c.center.x) * axis.x + (y[i] - c.center.y) * axis.y + (z[i] - c.center.z) * axis.z;
+            t = std::min(std::max(t * scale, 0.0f), 1.0f);
+            float dx = x[i] - (c.center.x + t * axis.x);
+            float dy = y[i] - (c.center.y + t * axis.y);
+            float dz = z[i] - (c.center.z + t * axis.z);
+            float squared = dx * dx + dy * dy + dz * dz;
+            float distance = std::sqrt(squared);
+            float divisor = squared > 0.0f ? distance : 1.0f;
+            bool contact = movable[i] != 0.0f && squared < reach * reach && squared > 0.0f;
+            depth[i] = contact ? reach - distance : 0.0f;
+            nx[i] = dx / divisor;
+            ny[i] = dy / divisor;
+            nz[i] = dz / divisor;
+        }
+        break;
+    }
+    case Collider::Box: {
+        // Inside the box the particle leaves through the nearest face,
+        // outside it moves away from the nearest point of the box. Both are
+        // computed in the frame of the box and the one that applies is kept.
+        glm::mat3 r = c.rotation;
+        glm::vec3 half = c.halfExtents;
+        float reach = thickness;
+        SIMD_LOOP
+        for (int i = 0; i < count; ++i) {
+            float px = x[i] - c.center.x, py = y[i] - c.center.y, pz = z[i] - c.center.z;
+            float lx = r[0].x * px + r[0].y * py + r[0].z * pz;
+            float ly = r[1].x * px + r[1].y * py + r[1].z * pz;
+            float lz = r[2].x * px + r[2].y * py + r[2].z * pz;
+            float qx = std::abs(lx) - half.x, qy = std::abs(ly) - half.y, qz = std::abs(lz) - half.z;
+            float outside = std::max(std::max(qx, qy), qz);
+
+            // The nearest face is on the first axis whose q is the largest.
+            float alongX = qx == outside ? 1.0f : 0.0f;
+            float alongY = (1.0f - alongX) * (qy == outside ? 1.0f : 0.0f);
+            float alongZ = 1.0f - alongX - alongY;
+            float fx = alongX * std::copysign(1.0f, lx);
+            float fy = alongY * std::copysign(1.0f, ly);
+            float fz = alongZ * std::copysign(1.0f, lz);
+
+            float dx = lx - std::min(std::max(lx, -half.x), half.x);
+            float dy = ly - std::min(std::max(ly, -half.y), half.y);
+            float dz = lz - std::min(std::max(lz, -half.z), half.z);
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            float divisor = distance > 0.0f ? distance : 1.0f;
+
+            float ux = outside <= 0.0f ? fx : dx / divisor;
+            float uy = outside <= 0.0f ? fy : dy / divisor;
+            float uz = outside <= 0.0f ? fz : dz / divisor;
+            float gap = outside <= 0.0f ? outside : distance;
+            depth[i] = movable[i] != 0.0f ? reach - gap : 0.0f;
+            nx[i] = r[0].x * ux + r[1].x * uy + r[2].x * uz;
+            ny[i] = r[0].y * ux + r[1].y * uy + r[2].y * uz;
+            nz[i] = r[0].z * ux + r[1].z * uy + r[2].z * uz;
+        }
+        break;
+    }
+    case Collider::Plane: {
+        float offset = glm::dot(c.normal, c.center) + thickness;
+        SIMD_LOOP
+        for (int i = 0; i < count; ++i) {
+            float d = offset - (c.normal.x * x[i] + c.normal.y * y[i] + c.normal.z * z[i]);
+            depth[i] = movable[i] != 0.0f ? d : 0.0f;
+            nx[i] = c.normal.x;
+            ny[i] = c.normal.y;
+            nz[i] = c.normal.z;
+        }
+        break;
+    }
+    }
+
+    int contacts = 0;
+    for (int i = 0; i < count; ++i) {
+        if (depth[i] <= 0.0f)
+            continue;
+        push(particles[begin + i], glm::vec3(nx[i], ny[i], nz[i]), depth[i], friction);
+        ++contacts;
+    }
+    return contacts;
+}
+
+// Projects the particles out of the given mesh, keeping them thickness away
+// from their nearest triangle on the side they came from, given by the
+// previous position. When searching in the middle of a step, the nearest
+// triangle is looked for as far as the particle moved since the last step,
+// so a particle that crossed the mesh during the step is still sent back;
+// at the end of a step it is looked for within thickness.
+int Colliders::projectMesh(TriangleCollider &mesh, std::vector<int> &nearest, std::vector<Particle> &particles,
+                           bool final, bool search) {
+    int size = static_cast<int>(particles.size());
+    float friction = final ? mesh.friction : 0.0f;
+    int contacts = 0;
+    nearest.resize(size, -1);
+    bool started = static_cast<int>(starts.size()) == size;
+
+    #pragma omp parallel for reduction(+:contacts) schedule(dynamic, 256)
+    for (int k = 0; k < size; ++k) {
+        Particle &p = particles[k];
+        if (p.inverseMass == 0.0f)
+            continue;
+        if (search) {
+            glm::vec3 start = started ? starts[k] : p.previousPosition;
+            float radius = final ? thickness : thickness + glm::length(p.position - start);
+            int t = mesh.nearest(p.position, radius);
+            if (t >= 0) {
+                glm::vec3 side = start - mesh.closest(t, start);
+                t = 2 * t + (glm::dot(side, mesh.normal(t)) < 0.0f ? 1 : 0);
+            }
+            nearest[k] = t;
+        }
+        if (nearest[k] < 0)
+            continue;
+
+        int t = nearest[k] / 2;
+        glm::vec3 n = nearest[k] % 2 ? -mesh.normal(t) : mesh.normal(t);
+        glm::vec3 d = p.position - mesh.closest(t, p.position);
+        float height = glm::dot(d, n);
+        float distance = glm::length(d);
+        if (height >= thickness || (distance >= thickness && height > 0.0f))
+            continue;
+        if (height > 0.0f)
+            push(p, d / distance, thickness - distance, friction);
+        else
+            push(p, n, thickness - height, friction);
+        ++contacts;
+    }
+    return contacts;
+}
+
+// Projects the particles out of the given distance field, moving them
+// along the gradient until they are thickness away from the surface.
+int Colliders::projectField(DistanceField &field, std::vector<Particle> &particles, bool final) {
+    int size = static_cast<int>(particles.size());
+    float friction = final ? field.friction : 0.0f;
+    int contacts = 0;
+
+    #pragma omp parallel for reduction(+:contacts)
+    for (int k = 0; k < size; ++k) {
+        Particle &p = particles[k];
+        if (p.inverseMass == 0.0f)
+            continue;
+        glm::vec3 gradient;
+        float distance = field.distance(p.position, gradient);
+        float length = glm::length(gradient);
+        if (distance >= thickness || length <= 0.0f)
+            continue;
+        push(p, gradient / length, thickness - distance, friction);
+        ++contacts;
+    }
+    return contacts;
+}
@@ -0,0 +1,141 @@
+#ifndef COLLIDERS_H
+#define COLLIDERS_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "continuouscollision.h"
+#include "distancefield.h"
+#include "particle.h"
+#include "trianglecollider.h"
+
+// Struct that represents an analytic collider. Spheres and capsules use
+// radius; a capsule is the set of points within radius of the segment from
+// center to end. A box is centered at center, with the given half extents
+// along the columns of rotation. A plane goes through center and keeps the
+// particles on the side its normal points to. Every shape has its own
+// friction and, except the plane, an axis aligned bounding box.
+struct Collider {
+    enum Shape { Sphere, Capsule, Box, Plane };
+    Shape shape;
+    glm::vec3 center;
+    glm::vec3 end;
+    glm::vec3 normal;
+    glm::vec3 halfExtents;
+    glm::mat3 rotation;
+    float radius;
+    float friction;
+    glm::vec3 low, high;
+};
+
+// Class responsible for the collisions of the particles with a set of
+// analytic colliders. The particles are processed in blocks of consecutive
+// indices, which are close to each other in a cloth: the bounding box of
+// each block is tested against the bounding box of every collider, and only
+// the colliders that overlap it are tested against the particles of the
+// block. The narrowphase runs one collider at a time over the particles of
+// the block, so its inner loop is the same for every particle and is easy
+// to vectorize. Projecting is cheap enough to be done after every relaxation
+// iteration, so the contacts and the bars converge together. Triangle
+// meshes are handled after the analytic shapes: a query of their hierarchy
+// is too slow for every iteration, so the first projection of a step finds
+// the nearest triangle of each particle within the distance it may still
+// travel, the following ones only project onto that triangle, and the final
+// one queries the hierarchy again. Static colliders baked into distance
+// fields only need a lookup per particle, so they are projected in full
+// every time.
+class Colliders {
+    // Nearest triangle of each particle in each mesh, twice its index plus
+    // one when the particle is behind it, or -1.
+    std::vector<std::vector<int>> candidates;
+
+    // Whether the candidates must be found again.
+    bool stale;
+
+    // Position of every particle at the start of the step. The side of a
+    // mesh a particle came from is taken from it, since some solvers set
+    // previousPosition back to imply their velocity instead.
+    std::vector<glm::vec3> starts;
+
+public:
+    std::vector<Collider> shapes;
+    std::vector<TriangleCollider> meshes;
+    std::vector<DistanceField> fields;
+
+    // Continuous collisions with the triangle meshes, checked at the end of
+    // every step before the final projection.
+    ContinuousCollision continuous;
+
+    // Distance kept between the particles and the surface of the colliders.
+    // The triangle meshes are only projected when it is positive: they are
+    // open surfaces, and a particle left exactly on one has no side to be
+    // kept on, so rounding would send it through.
+    float thickness;
+
+    // Constructor responsible for creating an empty set.
+    Colliders();
+
+    // Whether there is any collider.
+    bool enabled();
+
+    // Adds a sphere, a capsule, a box or a plane.
+    void addSphere(glm::vec3 center, float radius, float friction = 0.0f);
+    void addCapsule(glm::vec3 a, glm::vec3 b, float radius, float friction = 0.0f);
+    void addBox(glm::vec3 center, glm::vec3 halfExtents, glm::mat3 rotation = glm::mat3(1.0f), float friction = 0.0f);
+    void addPlane(glm::vec3 point, glm::vec3 normal, float friction = 0.0f);
+
+    // Adds a triangle mesh, building its hierarchy.
+    void addMesh(const std::vector<glm::vec3> &vertices, const std::vector<glm::ivec3> &triangles,
+                 float friction = 0.0f);
+
+    // Adds the triangle mesh of a Wavefront OBJ file. Returns false when it
+    // cannot be read.
+    bool loadMesh(const std::string &path, float friction = 0.0f);
+
+    // Adds a static collider baked into a distance field with the given cell
+    // size and band, cached in the given directory. The band must be wider
+    // than the distance a particle moves in a step, or fast particles may
+    // go through. Returns false when there are no triangles.
+    bool addDistanceField(const std::vector<glm::vec3> &vertices, const std::vector<glm::ivec3> &triangles,
+                          float cellSize, int bandCells, const std::string &cacheDirectory, float friction = 0.0f);
+
+    // Adds the triangle mesh of a Wavefront OBJ file as a distance field.
+    // Returns false when it cannot be read.
+    bool loadDistanceField(const std::string &path, float cellSize, int bandCells,
+                           const std::string &cacheDirectory, float friction = 0.0f);
+
+    // Computes the bounding boxes of the analytic shapes again. Must be
+    // called after moving them; the meshes are refit on their own.
+    void updateBounds();
+
+    // Moves every particle inside a collider to its surface. The friction is
+    // only applied when final is set, at the end of a step, since the
+    // projection runs many times per step. Returns the number of contacts.
+    int project(std::vector<Particle> &particles, bool final);
+
+    // Stores where the particles start the step when there are triangle
+    // meshes. Must be called before every step.
+    void begin(std::vector<Particle> &particles);
+
+    // Takes the particles that crossed a triangle mesh during the step back
+    // to where they hit it, receiving the surface triangles of the cloth, and
+    // settles the meshes. Must be called once at the end of every step.
+    // Returns the number of particles moved.
+    int sweep(std::vector<Particle> &particles, std::vector<glm::ivec3> &triangles);
+
+private:
+    // Computes the bounding box of the given collider.
+    void updateBounds(Collider &c);
+
+    // Projects the particles [begin, end) out of the given collider.
+    int projectBlock(Collider &c, std::vector<Particle> &particles, int begin, int end, bool final);
+
+    // Projects the particles out of the given mesh, finding their nearest
+    // triangles first when search is set.
+    int projectMesh(TriangleCollider &mesh, std::vector<int> &nearest, std::vector<Particle> &particles,
+                    bool final, bool search);
+
+    // Projects the particles out of the given distance field.
+    int projectField(DistanceField &field, std::vector<Particle> &particles, bool final);
+};
+
+#endif // COLLIDERS_H
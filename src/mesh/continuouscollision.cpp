@@ -0,0 +1,371 @@
+#include "continuouscollision.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Maximum number of detection passes. Moving a particle back may make the
+// edges to its neighbours hit, so detection runs again on the new motion;
+// in the second half of the passes, particles that still hit are left where
+// they were at the start of the step, which has no collisions.
+const int PASSES = 8;
+
+// Coefficients, lowest degree first, of the cubic whose roots are the times
+// at which the vectors e1, e2 and w, moving linearly by de1, de2 and dw over
+// the step, are coplanar: (e1 x e2) . w = 0. Computed in double precision,
+// since the coefficients cancel each other near the roots. Returns false
+// when the cubic vanishes, which happens when the motion keeps them coplanar.
+bool coplanarity(glm::vec3 e1, glm::vec3 de1, glm::vec3 e2, glm::vec3 de2, glm::vec3 w, glm::vec3 dw,
+                 double k[4]) {
+    glm::dvec3 a(e1), da(de1), b(e2), db(de2), c(w), dc(dw);
+    glm::dvec3 n0 = glm::cross(a, b);
+    glm::dvec3 n1 = glm::cross(a, db) + glm::cross(da, b);
+    glm::dvec3 n2 = glm::cross(da, db);
+    k[0] = glm::dot(n0, c);
+    k[1] = glm::dot(n1, c) + glm::dot(n0, dc);
+    k[2] = glm::dot(n2, c) + glm::dot(n1, dc);
+    k[3] = glm::dot(n2, dc);
+
+    double scale = glm::length(a) + glm::length(da) + glm::length(b) + glm::length(db)
+                 + glm::length(c) + glm::length(dc);
+    double size = std::abs(k[0]) + std::abs(k[1]) + std::abs(k[2]) + std::abs(k[3]);
+    return size > 1e-10 * scale * scale * scale;
+}
+
+// Value of the cubic k at t.
+double cubic(const double k[4], double t) {
+    return ((k[3] * t + k[2]) * t + k[1]) * t + k[0];
+}
+
+// Roots of the cubic k in [0, 1], in increasing order. The interval is split
+// at the roots of the derivative, so the cubic is monotonic in every piece
+// and each sign change is found by bisection.
+int cubicRoots(const double k[4], double roots[3]) {
+    double ends[4] = {0.0, 1.0, 1.0, 1.0};
+    int count = 1;
+    double a = 3.0 * k[3], b = 2.0 * k[2], c = k[1];
+    if (std::abs(a) > 1e-300) {
+        double discriminant = b * b - 4.0 * a * c;
+        if (discriminant >= 0.0) {
+            double root = std::sqrt(discriminant);
+            double t1 = (-b - root) / (2.0 * a), t2 = (-b + root) / (2.0 * a);
+            if (t1 > t2)
+                std::swap(t1, t2);
+            if (t1 > 0.0 && t1 < 1.0)
+                ends[count++] = t1;
+            if (t2 > 0.0 && t2 < 1.0)
+                ends[count++] = t2;
+        }
+    } else if (std::abs(b) > 1e-300) {
+        double t = -c / b;
+        if (t > 0.0 && t < 1.0)
+            ends[count++] = t;
+    }
+    ends[count++] = 1.0;
+
+    int found = 0;
+    for (int i = 0; i + 1 < count; ++i) {
+        double low = ends[i], high = ends[i + 1];
+        double fLow = cubic(k, low), fHigh = cubic(k, high);
+        if (fLow == 0.0) {
+            if (found == 0 || roots[found - 1] < low)
+                roots[found++] = low;
+            continue;
+        }
+        if ((fLow < 0.0) == (fHigh < 0.0))
+            continue;
+        for (int j = 0; j < 60; ++j) {
+            double middle = 0.5 * (low + high);
+            double fMiddle = cubic(k, middle);
+            if ((fMiddle < 0.0) == (fLow < 0.0)) {
+                low = middle;
+                fLow = fMiddle;
+            } else {
+                high = middle;
+            }
+        }
+        roots[found++] = high;
+    }
+    return std::min(found, 3);
+}
+
+// Distance between the segments p1q1 and p2q2 (Ericson, Real-Time
+// Collision Detection, 5.1.9).
+float segmentDistance(glm::vec3 p1, glm::vec3 q1, glm::vec3 p2, glm::vec3 q2) {
+    glm::vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+    float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+    float s = 0.0f, t = 0.0f;
+    if (a <= 0.0f && e <= 0.0f)
+        return glm::length(r);
+    if (a <= 0.0f) {
+        t = glm::clamp(f / e, 0.0f, 1.0f);
+    } else {
+        float c = glm::dot(d1, r);
+        if (e <= 0.0f) {
+            s = glm::clamp(-c / a, 0.0f, 1.0f);
+        } else {
+            float b = glm::dot(d1, d2);
+            float denominator = a * e - b * b;
+            s = denominator > 0.0f ? glm::clamp((b * f - c * e) / denominator, 0.0f, 1.0f) : 0.0f;
+            t = (b * s + f) / e;
+            if (t < 0.0f) {
+                t = 0.0f;
+                s = glm::clamp(-c / a, 0.0f, 1.0f);
+            } else if (t > 1.0f) {
+                t = 1.0f;
+                s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+            }
+        }
+    }
+    return glm::length(p1 + s * d1 - (p2 + t * d2));
+}
+
+// Unit normal of the triangle abc facing the side of the given offset from
+// it, or facing against the given motion when the offset is in its plane.
+glm::vec3 facing(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 offset, glm::vec3 motion) {
+    glm::vec3 n = glm::cross(b - a, c - a);
+    float length = glm::length(n);
+    if (length <= 0.0f)
+        return glm::vec3(0.0f);
+    n /= length;
+    float side = glm::dot(n, offset);
+    if (side == 0.0f)
+        side = -glm::dot(n, motion);
+    return side < 0.0f ? -n : n;
+}
+
+}
+
+// Constructor responsible for creating a disabled solver.
+ContinuousCollision::ContinuousCollision() : analyzedTriangles(0), rebuild(true), iterations(0) { }
+
+// Whether the continuous collisions should be handled.
+bool ContinuousCollision::enabled() {
+    return iterations > 0;
+}
+
+// Makes the next solve build the edges again.
+void ContinuousCollision::invalidate() {
+    rebuild = true;
+}
+
+// Builds the edges of the given triangles, skipping the unused slots, and
+// removes the copies of the edges shared by two triangles.
+void ContinuousCollision::buildEdges(std::vector<glm::ivec3> &triangles) {
+    analyzedTriangles = static_cast<int>(triangles.size());
+    rebuild = false;
+    edges.clear();
+    for (auto &t : triangles) {
+        if (t[0] < 0)
+            continue;
+        for (int i = 0; i < 3; ++i) {
+            int a = t[i], b = t[(i + 1) % 3];
+            edges.push_back(glm::ivec2(std::min(a, b), std::max(a, b)));
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](glm::ivec2 a, glm::ivec2 b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+}
+
+// First time of impact of the particle moving from p0 to p1 with triangle t
+// of the mesh: the first root of the coplanarity cubic at which the particle
+// is on the triangle, or the time at which conservative advancement comes
+// within the tolerance when the cubic vanishes. Running out of iterations
+// before that reports the last time reached, which is still safe, so a
+// pair that is closing is stopped there rather than let through.
+float ContinuousCollision::vertexTriangle(glm::vec3 p0, glm::vec3 p1, TriangleCollider &mesh, int t,
+                                          glm::vec3 &normal) {
+    glm::ivec3 f = mesh.triangles[t];
+    glm::vec3 a0 = mesh.previousVertices[f[0]], b0 = mesh.previousVertices[f[1]], c0 = mesh.previousVertices[f[2]];
+    glm::vec3 da = mesh.vertices[f[0]] - a0, db = mesh.vertices[f[1]] - b0, dc = mesh.vertices[f[2]] - c0;
+    glm::vec3 dp = p1 - p0;
+    float tolerance = 1e-3f * (glm::length(b0 - a0) + glm::length(c0 - a0));
+    normal = facing(a0, b0, c0, p0 - a0, dp - da);
+
+    double k[4];
+    if (coplanarity(b0 - a0, db - da, c0 - a0, dc - da, p0 - a0, dp - da, k)) {
+        double roots[3];
+        int count = cubicRoots(k, roots);
+        for (int i = 0; i < count; ++i) {
+            float s = static_cast<float>(roots[i]);
+            glm::vec3 a = a0 + s * da, b = b0 + s * db, c = c0 + s * dc, p = p0 + s * dp;
+            if (glm::length(p - TriangleCollider::closestPoint(p, a, b, c)) <= tolerance) {
+                normal = facing(a, b, c, normal, dp - da);
+                return s;
+            }
+        }
+        return 2.0f;
+    }
+
+    float speed = glm::length(dp) + std::max(glm::length(da), std::max(glm::length(db), glm::length(dc)));
+    float s = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        glm::vec3 a = a0 + s * da, b = b0 + s * db, c = c0 + s * dc, p = p0 + s * dp;
+        float distance = glm::length(p - TriangleCollider::closestPoint(p, a, b, c));
+        if (distance <= tolerance)
+            return s;
+        if (speed <= 0.0f)
+            return 2.0f;
+        s += distance / speed;
+        if (s > 1.0f)
+            return 2.0f;
+    }
+    return s;
+}
+
+// First time of impact of the segment moving from (p0, q0) to (p1, q1) with
+// the edges of triangle t of the mesh, the earliest over the three edges,
+// with the same safe time when conservative advancement runs out.
+float ContinuousCollision::edgeTriangle(glm::vec3 p0, glm::vec3 q0, glm::vec3 p1, glm::vec3 q1,
+                                        TriangleCollider &mesh, int t, glm::vec3 &normal) {
+    glm::ivec3 f = mesh.triangles[t];
+    glm::vec3 dp = p1 - p0, dq = q1 - q0;
+    float best = 2.0f;
+
+    for (int i = 0; i < 3; ++i) {
+        glm::vec3 a0 = mesh.previousVertices[f[i]], b0 = mesh.previousVertices[f[(i + 1) % 3]];
+        glm::vec3 da = mesh.vertices[f[i]] - a0, db = mesh.vertices[f[(i + 1) % 3]] - b0;
+        float tolerance = 1e-3f * (glm::length(q0 - p0) + glm::length(b0 - a0));
+        float hit = 2.0f;
+
+        double k[4];
+        if (coplanarity(q0 - p0, dq - dp, b0 - a0, db - da, a0 - p0, da - dp, k)) {
+            double roots[3];
+            int count = cubicRoots(k, roots);
+            for (int j = 0; j < count && hit > 1.0f; ++j) {
+                float s = static_cast<float>(roots[j]);
+                if (segmentDistance(p0 + s * dp, q0 + s * dq, a0 + s * da, b0 + s * db) <= tolerance)
+                    hit = s;
+            }
+        } else {
+            float speed = std::max(glm::length(dp), glm::length(dq)) + std::max(glm::length(da), glm::length(db));
+            float s = 0.0f;
+            int j = 0;
+            for (; j < iterations && s <= 1.0f; ++j) {
+                float distance = segmentDistance(p0 + s * dp, q0 + s * dq, a0 + s * da, b0 + s * db);
+                if (distance <= tolerance) {
+                    hit = s;
+                    break;
+                }
+                if (speed <= 0.0f)
+                    break;
+                s += distance / speed;
+            }
+            if (j == iterations && s <= 1.0f)
+                hit = s;
+        }
+        best = std::min(best, hit);
+    }
+    if (best > 1.0f)
+        return best;
+
+    glm::vec3 a0 = mesh.previousVertices[f[0]], b0 = mesh.previousVertices[f[1]], c0 = mesh.previousVertices[f[2]];
+    glm::vec3 side = facing(a0, b0, c0, 0.5f * (p0 + q0) - a0, 0.5f * (dp + dq) - (mesh.vertices[f[0]] - a0));
+    glm::vec3 a = glm::mix(a0, mesh.vertices[f[0]], best);
+    glm::vec3 b = glm::mix(b0, mesh.vertices[f[1]], best);
+    glm::vec3 c = glm::mix(c0, mesh.vertices[f[2]], best);
+    normal = facing(a, b, c, side, glm::vec3(0.0f));
+    return best;
+}
+
+// Takes every particle back to its first impact. The vertex-triangle tests
+// run in parallel over the particles and the edge-edge tests over the edges,
+// each only reading the positions; the impacts of the edges are then
+// gathered by their particles, and the particles are moved in parallel.
+int ContinuousCollision::solve(std::vector<Particle> &particles, std::vector<glm::vec3> &starts,
+                               std::vector<glm::ivec3> &triangles,
+                               std::vector<TriangleCollider> &meshes, float thickness) {
+    if (rebuild || analyzedTriangles != static_cast<int>(triangles.size()))
+        buildEdges(triangles);
+
+    int size = static_cast<int>(particles.size());
+    int count = static_cast<int>(edges.size());
+    particleNormals.resize(size);
+    edgeNormals.resize(count);
+
+    hit.assign(size, 0);
+    for (int pass = 0; pass < PASSES; ++pass) {
+        particleTimes.assign(size, 2.0f);
+        edgeTimes.assign(count, 2.0f);
+
+        #pragma omp parallel
+        {
+            std::vector<int> candidates;
+
+            #pragma omp for schedule(dynamic, 256)
+            for (int k = 0; k < size; ++k) {
+                Particle &p = particles[k];
+                if (p.inverseMass == 0.0f)
+                    continue;
+                glm::vec3 p0 = starts[k];
+                glm::vec3 low = glm::min(p0, p.position);
+                glm::vec3 high = glm::max(p0, p.position);
+                for (auto &mesh : meshes) {
+                    mesh.overlapping(low, high, candidates);
+                    for (int t : candidates) {
+                        glm::vec3 normal;
+                        float time = vertexTriangle(p0, p.position, mesh, t, normal);
+                        if (time < particleTimes[k]) {
+                            particleTimes[k] = time;
+                            particleNormals[k] = normal;
+                        }
+                    }
+                }
+            }
+
+            #pragma omp for schedule(dynamic, 256)
+            for (int i = 0; i < count; ++i) {
+                Particle &p = particles[edges[i].x];
+                Particle &q = particles[edges[i].y];
+                if (p.inverseMass == 0.0f && q.inverseMass == 0.0f)
+                    continue;
+                glm::vec3 p0 = starts[edges[i].x], q0 = starts[edges[i].y];
+                glm::vec3 low = glm::min(glm::min(p0, p.position), glm::min(q0, q.position));
+                glm::vec3 high = glm::max(glm::max(p0, p.position), glm::max(q0, q.position));
+                for (auto &mesh : meshes) {
+                    mesh.overlapping(low, high, candidates);
+                    for (int t : candidates) {
+                        glm::vec3 normal;
+                        float time = edgeTriangle(p0, q0, p.position, q.position,
+                                                  mesh, t, normal);
+                        if (time < edgeTimes[i]) {
+                            edgeTimes[i] = time;
+                            edgeNormals[i] = normal;
+                        }
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (edgeTimes[i] > 1.0f)
+                continue;
+            int ends[2] = {edges[i].x, edges[i].y};
+            for (int e : ends) {
+                if (particles[e].inverseMass != 0.0f && edgeTimes[i] < particleTimes[e]) {
+                    particleTimes[e] = edgeTimes[i];
+                    particleNormals[e] = edgeNormals[i];
+                }
+            }
+        }
+
+        int hits = 0;
+        #pragma omp parallel for reduction(+:hits)
+        for (int k = 0; k < size; ++k) {
+            if (particleTimes[k] > 1.0f)
+                continue;
+            Particle &p = particles[k];
+            if (pass < PASSES / 2)
+                p.position = glm::mix(starts[k], p.position, particleTimes[k]) + thickness * particleNormals[k];
+            else
+                p.position = starts[k];
+            hit[k] = 1;
+            ++hits;
+        }
+        if (hits == 0)
+            break;
+    }
+    return static_cast<int>(std::count(hit.begin(), hit.end(), 1));
+}
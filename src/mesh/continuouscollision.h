@@ -0,0 +1,86 @@
+#ifndef CONTINUOUSCOLLISION_H
+#define CONTINUOUSCOLLISION_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "particle.h"
+#include "trianglecollider.h"
+
+// Class responsible for the continuous collisions of the cloth with the
+// triangle colliders, so thin colliders are not crossed between steps even
+// with large steps or fast motion. Every particle moves linearly from where
+// it started the step to its position, and every collider vertex from its
+// previous vertex to its vertex; the start is given apart, since some
+// solvers set previousPosition back to imply their velocity instead. The
+// candidates are the triangles whose swept bounds overlap the swept box of a
+// particle or of an edge of the cloth, found in the hierarchy of each
+// collider. Only the edges of the surface triangles are swept: bending and
+// shear bars are chords under the cloth and may cross a thin collider the
+// cloth lies on. For each candidate, the times at which a particle and a
+// triangle, or a cloth edge and an edge of a triangle, become coplanar are
+// the roots of a cubic (Provot 1997; Bridson et al. 2002), and the first
+// root at which they also touch is the time of impact. When the motion keeps
+// them coplanar the cubic vanishes, and conservative advancement is used
+// instead: time moves forward by the distance between them over the largest
+// speed at which it can shrink, and the time reached when the iterations
+// run out counts as the impact, since it is the last one known to be safe.
+//
+// Every particle is then taken back to where it was at its earliest impact,
+// over its own motion and that of its edges, and lifted thickness off the
+// triangle on the side it came from. Since that changes the motion of its
+// edges, the detection runs again until nothing is hit, a few passes at most.
+class ContinuousCollision {
+    // Edges of the surface triangles of the cloth, each one once, and the
+    // number of triangles they were built from.
+    std::vector<glm::ivec2> edges;
+    int analyzedTriangles;
+    bool rebuild;
+
+    // Earliest time of impact of each particle and of each edge, more than 1
+    // meaning none, and normal of the triangle hit, facing the particle.
+    std::vector<float> particleTimes;
+    std::vector<glm::vec3> particleNormals;
+    std::vector<float> edgeTimes;
+    std::vector<glm::vec3> edgeNormals;
+
+    // Whether each particle was moved during the solve.
+    std::vector<char> hit;
+
+    // Builds the edges of the given triangles.
+    void buildEdges(std::vector<glm::ivec3> &triangles);
+
+    // First time of impact of the particle moving from p0 to p1 with
+    // triangle t of the mesh, or 2 when there is none, and the normal of the
+    // triangle at that time, facing the side the particle came from.
+    float vertexTriangle(glm::vec3 p0, glm::vec3 p1, TriangleCollider &mesh, int t, glm::vec3 &normal);
+
+    // First time of impact of the segment moving from (p0, q0) to (p1, q1)
+    // with the edges of triangle t of the mesh, or 2 when there is none, and
+    // the normal of the triangle at that time, facing the segment.
+    float edgeTriangle(glm::vec3 p0, glm::vec3 q0, glm::vec3 p1, glm::vec3 q1, TriangleCollider &mesh, int t,
+                       glm::vec3 &normal);
+
+public:
+    // Maximum number of conservative advancement iterations. The continuous
+    // collisions are disabled when it is 0.
+    int iterations;
+
+    // Constructor responsible for creating a disabled solver.
+    ContinuousCollision();
+
+    // Whether the continuous collisions should be handled.
+    bool enabled();
+
+    // Makes the next solve build the edges again. Must be called when the
+    // triangles change without changing their number.
+    void invalidate();
+
+    // Takes every particle back to its first impact with the meshes during
+    // the step, leaving it thickness off the triangle hit, receiving where
+    // the particles started and the surface triangles of the cloth. Returns
+    // the number of particles moved.
+    int solve(std::vector<Particle> &particles, std::vector<glm::vec3> &starts, std::vector<glm::ivec3> &triangles,
+              std::vector<TriangleCollider> &meshes, float thickness);
+};
+
+#endif // CONTINUOUSCOLLISION_H
@@ -0,0 +1,371 @@
+#include "distancefield.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Header of a cache file, followed by the values.
+struct Header {
+    char magic[4];
+    int version;
+    unsigned long long hash;
+    float origin[3];
+    float cellSize;
+    int size[3];
+    float band;
+};
+
+const int VERSION = 1;
+
+// Adds the given bytes to a 64 bit FNV-1a hash.
+unsigned long long addHash(unsigned long long hash, const void *data, size_t bytes) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < bytes; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Solution of the discrete eikonal equation |grad d| = 1 at a point whose
+// smallest neighbour along each axis is a, b and c, for a spacing h.
+float solveEikonal(float a, float b, float c, float h) {
+    if (a > b) std::swap(a, b);
+    if (b > c) std::swap(b, c);
+    if (a > b) std::swap(a, b);
+
+    float d = a + h;
+    if (d <= b)
+        return d;
+    d = 0.5f * (a + b + std::sqrt(std::max(2.0f * h * h - (a - b) * (a - b), 0.0f)));
+    if (d <= c)
+        return d;
+    float sum = a + b + c;
+    float discriminant = sum * sum - 3.0f * (a * a + b * b + c * c - h * h);
+    return (sum + std::sqrt(std::max(discriminant, 0.0f))) / 3.0f;
+}
+
+// Normal of the feature of the triangle f nearest to the point q on it:
+// the angle weighted normal of a vertex, the normal of an edge or the normal
+// of the face (Baerentzen and Aanaes 2005). The sign of the distance given
+// by these normals is right for any closed mesh, even next to its edges and
+// vertices.
+glm::vec3 pseudoNormal(glm::ivec3 f, glm::vec3 q, const std::vector<glm::vec3> &vertices,
+                       const std::vector<glm::vec3> &vertexNormals,
+                       const std::map<std::pair<int, int>, glm::vec3> &edgeNormals, glm::vec3 faceNormal) {
+    glm::vec3 a = vertices[f[0]], b = vertices[f[1]], c = vertices[f[2]];
+    glm::vec3 ab = b - a, ac = c - a, aq = q - a;
+    float d00 = glm::dot(ab, ab), d01 = glm::dot(ab, ac), d11 = glm::dot(ac, ac);
+    float denominator = d00 * d11 - d01 * d01;
+    if (denominator <= 0.0f) {
+        glm::vec3 d(glm::length(q - a), glm::length(q - b), glm::length(q - c));
+        int corner = d.x <= d.y && d.x <= d.z ? 0 : (d.y <= d.z ? 1 : 2);
+        return vertexNormals[f[corner]];
+    }
+
+    float d20 = glm::dot(aq, ab), d21 = glm::dot(aq, ac);
+    float v = (d11 * d20 - d01 * d21) / denominator;
+    float w = (d00 * d21 - d01 * d20) / denominator;
+    float weights[3] = {1.0f - v - w, v, w};
+    const float epsilon = 1e-5f;
+    int zero = -1, zeros = 0;
+    for (int i = 0; i < 3; ++i) {
+        if (weights[i] < epsilon) {
+            zero = i;
+            ++zeros;
+        }
+    }
+    if (zeros == 0)
+        return faceNormal;
+    if (zeros == 1) {
+        int i = f[(zero + 1) % 3], j = f[(zero + 2) % 3];
+        return edgeNormals.find(std::make_pair(std::min(i, j), std::max(i, j)))->second;
+    }
+    int corner = weights[0] >= weights[1] && weights[0] >= weights[2] ? 0 : (weights[1] >= weights[2] ? 1 : 2);
+    return vertexNormals[f[corner]];
+}
+
+}
+
+// Constructor responsible for creating an empty field.
+DistanceField::DistanceField() : values(nullptr), cellSize(0.0f), size(0), band(0.0f), friction(0.0f) { }
+
+// Creates the field of the given triangles. The grid covers their bounds
+// plus the band and one more cell, so a lookup never reaches past it while
+// inside the band.
+bool DistanceField::create(const std::vector<glm::vec3> &vertices, const std::vector<glm::ivec3> &triangles,
+                           float cellSize, int bandCells, const std::string &cacheDirectory) {
+    if (triangles.empty() || cellSize <= 0.0f)
+        return false;
+
+    glm::vec3 low = vertices[triangles[0][0]], high = low;
+    for (auto &t : triangles) {
+        for (int j = 0; j < 3; ++j) {
+            low = glm::min(low, vertices[t[j]]);
+            high = glm::max(high, vertices[t[j]]);
+        }
+    }
+    bandCells = std::max(bandCells, 1);
+    float margin = (bandCells + 1) * cellSize;
+    this->cellSize = cellSize;
+    this->band = bandCells * cellSize;
+    this->origin = low - margin;
+    this->size = glm::ivec3(glm::ceil((high - low + 2.0f * margin) / cellSize)) + 1;
+
+    unsigned long long hash = 14695981039346656037ULL;
+    hash = addHash(hash, vertices.data(), vertices.size() * sizeof(glm::vec3));
+    hash = addHash(hash, triangles.data(), triangles.size() * sizeof(glm::ivec3));
+    hash = addHash(hash, &cellSize, sizeof(cellSize));
+    hash = addHash(hash, &bandCells, sizeof(bandCells));
+
+    std::string path;
+    if (!cacheDirectory.empty()) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/%016llx.sdf", hash);
+        path = cacheDirectory + name;
+        if (map(path, hash))
+            return true;
+    }
+
+    TriangleCollider mesh(vertices, triangles);
+    std::shared_ptr<std::vector<float>> grid = std::make_shared<std::vector<float>>();
+    bake(mesh, *grid);
+    if (!path.empty() && save(path, hash, *grid) && map(path, hash))
+        return true;
+    values = grid->data();
+    storage = grid;
+    return true;
+}
+
+// Whether the field has been created.
+bool DistanceField::valid() {
+    return values != nullptr;
+}
+
+// Fills the grid with the signed distances of the given mesh. The points
+// near the triangles are exact and frozen; the sweeps then propagate the
+// magnitude through the whole grid, each point taking the sign of the
+// neighbour it was reached from, so the points deep inside are negative too,
+// and the magnitudes are finally clamped to the band.
+void DistanceField::bake(TriangleCollider &mesh, std::vector<float> &grid) {
+    int nx = size.x, ny = size.y, nz = size.z;
+    int count = nx * ny * nz;
+    grid.assign(count, INFINITY);
+    std::vector<signed char> sign(count, 1);
+    std::vector<unsigned char> frozen(count, 0);
+    float reach = std::sqrt(3.0f) * cellSize;
+
+    std::vector<glm::vec3> &vertices = mesh.vertices;
+    std::vector<glm::vec3> vertexNormals(vertices.size(), glm::vec3(0.0f));
+    std::map<std::pair<int, int>, glm::vec3> edgeNormals;
+    for (int t = 0; t < static_cast<int>(mesh.triangles.size()); ++t) {
+        glm::ivec3 f = mesh.triangles[t];
+        glm::vec3 n = mesh.normal(t);
+        for (int i = 0; i < 3; ++i) {
+            glm::vec3 e1 = vertices[f[(i + 1) % 3]] - vertices[f[i]];
+            glm::vec3 e2 = vertices[f[(i + 2) % 3]] - vertices[f[i]];
+            float lengths = glm::length(e1) * glm::length(e2);
+            if (lengths > 0.0f)
+                vertexNormals[f[i]] += std::acos(glm::clamp(glm::dot(e1, e2) / lengths, -1.0f, 1.0f)) * n;
+            int j = f[(i + 1) % 3];
+            edgeNormals[std::make_pair(std::min(f[i], j), std::max(f[i], j))] += n;
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int k = 0; k < nz; ++k) {
+        for (int j = 0; j < ny; ++j) {
+            for (int i = 0; i < nx; ++i) {
+                glm::vec3 x = origin + cellSize * glm::vec3(i, j, k);
+                int t = mesh.nearest(x, reach);
+                if (t < 0)
+                    continue;
+                int index = (k * ny + j) * nx + i;
+                glm::vec3 q = mesh.closest(t, x);
+                glm::vec3 n = pseudoNormal(mesh.triangles[t], q, vertices, vertexNormals, edgeNormals, mesh.normal(t));
+                grid[index] = glm::length(x - q);
+                sign[index] = glm::dot(x - q, n) < 0.0f ? -1 : 1;
+                frozen[index] = 1;
+            }
+        }
+    }
+
+    // Eight sweeps, one per ordering of the axes, each going through the
+    // diagonal planes in order and updating the points of a plane in
+    // parallel.
+    int planes = nx + ny + nz - 2;
+    for (int sweep = 0; sweep < 8; ++sweep) {
+        bool flipX = (sweep & 1) != 0, flipY = (sweep & 2) != 0, flipZ = (sweep & 4) != 0;
+        for (int plane = 0; plane < planes; ++plane) {
+            int firstI = std::max(0, plane - (ny - 1) - (nz - 1));
+            int lastI = std::min(nx - 1, plane);
+            #pragma omp parallel for schedule(static)
+            for (int a = firstI; a <= lastI; ++a) {
+                int firstJ = std::max(0, plane - a - (nz - 1));
+                int lastJ = std::min(ny - 1, plane - a);
+                for (int b = firstJ; b <= lastJ; ++b) {
+                    int i = flipX ? nx - 1 - a : a;
+                    int j = flipY ? ny - 1 - b : b;
+                    int k = flipZ ? nz - 1 - (plane - a - b) : plane - a - b;
+                    int index = (k * ny + j) * nx + i;
+                    if (frozen[index])
+                        continue;
+
+                    // Smallest neighbour along each axis, and the one of
+                    // them that gives the sign.
+                    int neighbours[3][2] = {{i > 0 ? index - 1 : -1, i < nx - 1 ? index + 1 : -1},
+                                            {j > 0 ? index - nx : -1, j < ny - 1 ? index + nx : -1},
+                                            {k > 0 ? index - nx * ny : -1, k < nz - 1 ? index + nx * ny : -1}};
+                    float smallest[3];
+                    int nearest = -1;
+                    for (int axis = 0; axis < 3; ++axis) {
+                        smallest[axis] = INFINITY;
+                        for (int side = 0; side < 2; ++side) {
+                            int n = neighbours[axis][side];
+                            if (n >= 0 && grid[n] < smallest[axis]) {
+                                smallest[axis] = grid[n];
+                                if (nearest < 0 || grid[n] < grid[nearest])
+                                    nearest = n;
+                            }
+                        }
+                    }
+                    if (nearest < 0)
+                        continue;
+                    float d = solveEikonal(smallest[0], smallest[1], smallest[2], cellSize);
+                    if (d < grid[index]) {
+                        grid[index] = d;
+                        sign[index] = sign[nearest];
+                    }
+                }
+            }
+        }
+    }
+
+    #pragma omp parallel for
+    for (int index = 0; index < count; ++index)
+        grid[index] = sign[index] * std::min(grid[index], band);
+}
+
+// Maps the cache file at path, checking its header against the grid
+// settings and the hash.
+bool DistanceField::map(const std::string &path, unsigned long long hash) {
+    size_t bytes = sizeof(Header) + sizeof(float) * size.x * size.y * size.z;
+    const void *data = nullptr;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(file, &length) || static_cast<unsigned long long>(length.QuadPart) != bytes) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr)
+        return false;
+    data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == nullptr)
+        return false;
+    std::shared_ptr<const void> view(data, [](const void *p) { UnmapViewOfFile(p); });
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat status;
+    if (fstat(file, &status) != 0 || static_cast<size_t>(status.st_size) != bytes) {
+        close(file);
+        return false;
+    }
+    void *address = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (address == MAP_FAILED)
+        return false;
+    data = address;
+    std::shared_ptr<const void> view(data, [bytes](const void *p) { munmap(const_cast<void *>(p), bytes); });
+#endif
+
+    const Header *header = static_cast<const Header *>(data);
+    if (std::memcmp(header->magic, "SDF1", 4) != 0 || header->version != VERSION || header->hash != hash
+        || header->size[0] != size.x || header->size[1] != size.y || header->size[2] != size.z)
+        return false;
+
+    storage = view;
+    values = reinterpret_cast<const float *>(header + 1);
+    return true;
+}
+
+// Writes the grid to the cache file at path, through a temporary file so
+// a run that stops halfway never leaves a truncated cache behind.
+bool DistanceField::save(const std::string &path, unsigned long long hash, std::vector<float> &grid) {
+    Header header;
+    std::memcpy(header.magic, "SDF1", 4);
+    header.version = VERSION;
+    header.hash = hash;
+    for (int axis = 0; axis < 3; ++axis) {
+        header.origin[axis] = origin[axis];
+        header.size[axis] = size[axis];
+    }
+    header.cellSize = cellSize;
+    header.band = band;
+
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary.c_str(), std::ios::binary);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(grid.data()), sizeof(float) * grid.size());
+        if (!file)
+            return false;
+    }
+    std::remove(path.c_str());
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+// Signed distance from x to the collider, and its gradient, interpolating
+// the 8 grid points around x.
+float DistanceField::distance(glm::vec3 x, glm::vec3 &gradient) {
+    glm::vec3 u = (x - origin) / cellSize;
+    glm::ivec3 cell = glm::ivec3(glm::floor(u));
+    if (values == nullptr || glm::any(glm::lessThan(cell, glm::ivec3(0)))
+        || glm::any(glm::greaterThanEqual(cell, size - 1))) {
+        gradient = glm::vec3(0.0f);
+        return band;
+    }
+
+    glm::vec3 f = u - glm::vec3(cell);
+    int index = (cell.z * size.y + cell.y) * size.x + cell.x;
+    int dy = size.x, dz = size.x * size.y;
+    float c000 = values[index], c100 = values[index + 1];
+    float c010 = values[index + dy], c110 = values[index + dy + 1];
+    float c001 = values[index + dz], c101 = values[index + dz + 1];
+    float c011 = values[index + dz + dy], c111 = values[index + dz + dy + 1];
+
+    float c00 = c000 + f.x * (c100 - c000), c10 = c010 + f.x * (c110 - c010);
+    float c01 = c001 + f.x * (c101 - c001), c11 = c011 + f.x * (c111 - c011);
+    float c0 = c00 + f.y * (c10 - c00), c1 = c01 + f.y * (c11 - c01);
+
+    float gx0 = (c100 - c000) + f.y * ((c110 - c010) - (c100 - c000));
+    float gx1 = (c101 - c001) + f.y * ((c111 - c011) - (c101 - c001));
+    gradient.x = (gx0 + f.z * (gx1 - gx0)) / cellSize;
+    gradient.y = ((c10 - c00) + f.z * ((c11 - c01) - (c10 - c00))) / cellSize;
+    gradient.z = (c1 - c0) / cellSize;
+    return c0 + f.z * (c1 - c0);
+}
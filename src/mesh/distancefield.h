@@ -0,0 +1,68 @@
+#ifndef DISTANCEFIELD_H
+#define DISTANCEFIELD_H
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include "trianglecollider.h"
+
+// Class that represents a static collider as a narrow band signed distance
+// grid, negative inside. The grid points closer than a cell diagonal to the
+// triangles get their exact distance, signed by the normal of the nearest
+// triangle, so the triangles must face outwards; the rest of the band is
+// filled by a fast sweeping solution of the eikonal equation, whose sweeps
+// are parallelized over the diagonal planes i + j + k = constant, where no
+// point depends on another (Detrixhe et al. 2013). Points farther than the
+// band keep the band width.
+//
+// Baking is slow, so the grid is written to a cache directory, named after
+// a hash of the triangles and the grid settings, and later runs map that
+// file in memory instead of baking again. A lookup is a trilinear
+// interpolation of the 8 points around x.
+class DistanceField {
+    // Memory that holds the values, either the mapped cache file or a baked
+    // grid, and the values themselves, x fastest.
+    std::shared_ptr<const void> storage;
+    const float *values;
+
+    // Fills values with the signed distances of the given mesh.
+    void bake(TriangleCollider &mesh, std::vector<float> &grid);
+
+    // Maps the cache file at path. Returns false when it does not exist or
+    // does not match the given hash.
+    bool map(const std::string &path, unsigned long long hash);
+
+    // Writes the grid to the cache file at path.
+    bool save(const std::string &path, unsigned long long hash, std::vector<float> &grid);
+
+public:
+    // Corner of the grid, distance between its points, number of points
+    // along each axis and width of the band.
+    glm::vec3 origin;
+    float cellSize;
+    glm::ivec3 size;
+    float band;
+
+    float friction;
+
+    // Constructor responsible for creating an empty field.
+    DistanceField();
+
+    // Creates the field of the given triangles with the given cell size and
+    // a band of the given number of cells around them, reading it from the
+    // cache directory when it was baked before and writing it there
+    // otherwise. An empty directory disables the cache. Returns false when
+    // there are no triangles.
+    bool create(const std::vector<glm::vec3> &vertices, const std::vector<glm::ivec3> &triangles,
+                float cellSize, int bandCells, const std::string &cacheDirectory);
+
+    // Whether the field has been created.
+    bool valid();
+
+    // Signed distance from x to the collider, and its gradient. Outside the
+    // grid the distance is the band width and the gradient is zero.
+    float distance(glm::vec3 x, glm::vec3 &gradient);
+};
+
+#endif // DISTANCEFIELD_H
@@ -0,0 +1,62 @@
+#include "embedding.h"
+#include <algorithm>
+
+// Constructor responsible for creating an empty embedding.
+Embedding::Embedding() : n(0), m(0), factor(1), rows(0), columns(0) { }
+
+// Computes the stencil of the fine lines of a coarse dimension. Fine line k
+// lies in coarse cell c = k / factor at t = (k % factor) / factor and uses the
+// Catmull-Rom weights of lines c-1 to c+2; lines outside the mesh are clamped
+// to the border, which extends the border cells linearly.
+void Embedding::stencil(int coarse, std::vector<glm::ivec4> &indices, std::vector<glm::vec4> &weights) {
+    int fine = (coarse - 1) * factor + 1;
+    indices.resize(fine);
+    weights.resize(fine);
+    for (int k = 0; k < fine; ++k) {
+        int c = std::min(k / factor, coarse - 1);
+        float t = static_cast<float>(k - c * factor) / factor;
+        float t2 = t * t;
+        float t3 = t2 * t;
+        weights[k] = 0.5f * glm::vec4(-t3 + 2.0f*t2 - t,
+                                      3.0f*t3 - 5.0f*t2 + 2.0f,
+                                      -3.0f*t3 + 4.0f*t2 + t,
+                                      t3 - t2);
+        for (int a = 0; a < 4; ++a)
+            indices[k][a] = std::min(std::max(c - 1 + a, 0), coarse - 1);
+    }
+}
+
+// Precomputes the weights of the fine grid of a nxm mesh refined by factor.
+void Embedding::create(int n, int m, int factor) {
+    this->n = n;
+    this->m = m;
+    this->factor = std::max(factor, 1);
+    this->rows = (n - 1) * this->factor + 1;
+    this->columns = (m - 1) * this->factor + 1;
+    stencil(n, rowIndices, rowWeights);
+    stencil(m, columnIndices, columnWeights);
+}
+
+// Position of the fine vertex (i, j) for the current particle positions.
+glm::vec3 Embedding::position(std::vector<Particle> &particles, int i, int j) {
+    glm::ivec4 r = rowIndices[i];
+    glm::vec4 wr = rowWeights[i];
+    glm::ivec4 c = columnIndices[j];
+    glm::vec4 wc = columnWeights[j];
+    glm::vec3 sum(0.0f);
+    for (int a = 0; a < 4; ++a) {
+        glm::vec3 line = wc[0] * particles[r[a]*m + c[0]].position
+                       + wc[1] * particles[r[a]*m + c[1]].position
+                       + wc[2] * particles[r[a]*m + c[2]].position
+                       + wc[3] * particles[r[a]*m + c[3]].position;
+        sum += wr[a] * line;
+    }
+    return sum;
+}
+
+// Range [first, last) of fine rows that depend on the coarse rows
+// [begin, end). Coarse row r is in the stencil of the cells r-2 to r+1.
+void Embedding::fineRows(int begin, int end, int &first, int &last) {
+    first = std::max((begin - 2) * factor, 0);
+    last = std::min((end + 1) * factor + 1, rows);
+}
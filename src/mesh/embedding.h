@@ -0,0 +1,45 @@
+#ifndef EMBEDDING_H
+#define EMBEDDING_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "particle.h"
+
+// Class responsible for embedding a fine grid of render vertices in the
+// particles of a coarse rectangular mesh. Each coarse cell is split in
+// factor x factor fine cells and every fine vertex is a Catmull-Rom spline
+// interpolation of the 4x4 particles around it, so the fine surface goes
+// through every particle and stays smooth between them. The spline is a
+// tensor product, so the weights are precomputed once per fine row and per
+// fine column.
+class Embedding {
+    // Coarse rows and columns of the stencil of each fine row and column,
+    // and their weights.
+    std::vector<glm::ivec4> rowIndices;
+    std::vector<glm::vec4> rowWeights;
+    std::vector<glm::ivec4> columnIndices;
+    std::vector<glm::vec4> columnWeights;
+
+    // Computes the stencil of the fine lines of a coarse dimension.
+    void stencil(int coarse, std::vector<glm::ivec4> &indices, std::vector<glm::vec4> &weights);
+
+public:
+    // Size of the coarse mesh, refinement factor and size of the fine grid.
+    int n, m;
+    int factor;
+    int rows, columns;
+
+    // Constructor responsible for creating an empty embedding.
+    Embedding();
+
+    // Precomputes the weights of the fine grid of a nxm mesh refined by factor.
+    void create(int n, int m, int factor);
+
+    // Position of the fine vertex (i, j) for the current particle positions.
+    glm::vec3 position(std::vector<Particle> &particles, int i, int j);
+
+    // Range [first, last) of fine rows that depend on the coarse rows [begin, end).
+    void fineRows(int begin, int end, int &first, int &last);
+};
+
+#endif // EMBEDDING_H
@@ -0,0 +1,157 @@
+#include "forcefield.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+// Constructor responsible for creating an empty field.
+ForceField::ForceField()
+    : resolution(0), cellSize(1.0f), time(0.0f), wind(0.0f), gustStrength(0.0f), gustPeriod(4.0f),
+      gustSpeed(0.0f), turbulenceStrength(0.0f), turbulenceVelocity(0.0f) { }
+
+// Whether the field adds any force.
+bool ForceField::enabled() {
+    return wind != glm::vec3(0.0f) || (turbulenceStrength > 0.0f && resolution > 0) || !emitters.empty();
+}
+
+// Bakes the turbulence volume. A random vector potential is smoothed with a
+// few periodic [1 2 1] / 4 passes along each axis, which removes the
+// frequencies a trilinear lookup could not represent, and its curl is taken
+// with central differences. The result is scaled to unit mean magnitude.
+void ForceField::createTurbulence(int resolution, float cellSize, float strength, unsigned int seed) {
+    this->resolution = std::max(resolution, 4);
+    this->cellSize = cellSize;
+    this->turbulenceStrength = strength;
+    int r = this->resolution;
+    int size = r * r * r;
+
+    std::vector<glm::vec3> potential(size);
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    for (auto &p : potential)
+        p = glm::vec3(uniform(generator), uniform(generator), uniform(generator));
+
+    auto at = [r](int x, int y, int z) { return ((z + r) % r * r + (y + r) % r) * r + (x + r) % r; };
+    std::vector<glm::vec3> blurred(size);
+    for (int pass = 0; pass < 3; ++pass) {
+        for (int axis = 0; axis < 3; ++axis) {
+            glm::ivec3 step(axis == 0, axis == 1, axis == 2);
+            #pragma omp parallel for
+            for (int z = 0; z < r; ++z)
+                for (int y = 0; y < r; ++y)
+                    for (int x = 0; x < r; ++x)
+                        blurred[at(x, y, z)] = 0.25f * potential[at(x - step.x, y - step.y, z - step.z)]
+                                             + 0.5f * potential[at(x, y, z)]
+                                             + 0.25f * potential[at(x + step.x, y + step.y, z + step.z)];
+            potential.swap(blurred);
+        }
+    }
+
+    turbulence.resize(size);
+    double total = 0.0;
+    #pragma omp parallel for reduction(+:total)
+    for (int z = 0; z < r; ++z) {
+        for (int y = 0; y < r; ++y) {
+            for (int x = 0; x < r; ++x) {
+                glm::vec3 dx = potential[at(x + 1, y, z)] - potential[at(x - 1, y, z)];
+                glm::vec3 dy = potential[at(x, y + 1, z)] - potential[at(x, y - 1, z)];
+                glm::vec3 dz = potential[at(x, y, z + 1)] - potential[at(x, y, z - 1)];
+                glm::vec3 curl(dy.z - dz.y, dz.x - dx.z, dx.y - dy.x);
+                turbulence[at(x, y, z)] = curl;
+                total += glm::length(curl);
+            }
+        }
+    }
+    float scale = total > 0.0 ? static_cast<float>(size / total) : 0.0f;
+    for (auto &v : turbulence)
+        v *= scale;
+}
+
+// Adds a point or directional emitter.
+void ForceField::addEmitter(Emitter::Type type, glm::vec3 position, glm::vec3 direction, float strength, float radius) {
+    Emitter emitter;
+    emitter.type = type;
+    emitter.position = position;
+    emitter.direction = glm::length(direction) > 0.0f ? glm::normalize(direction) : glm::vec3(0.0f);
+    emitter.strength = strength;
+    emitter.radius = radius;
+    emitters.push_back(emitter);
+}
+
+// Advances the time of the field by h.
+void ForceField::advance(float h) {
+    time += h;
+}
+
+// Gust factor at time t: three sines of incommensurate frequencies, so the
+// signal does not repeat visibly, normalized to [1 - gustStrength,
+// 1 + gustStrength].
+float ForceField::gust(float t) {
+    float w = 6.2831853f / gustPeriod;
+    float s = std::sin(w * t) + 0.5f * std::sin(2.31f * w * t + 1.3f) + 0.25f * std::sin(5.13f * w * t + 0.7f);
+    return 1.0f + gustStrength * s / 1.75f;
+}
+
+// Trilinear lookup of the turbulence at x. The volume is periodic, so the
+// indices wrap around and the scrolled volume never runs out.
+glm::vec3 ForceField::turbulenceAt(glm::vec3 x) {
+    int r = resolution;
+    glm::vec3 u = (x - time * turbulenceVelocity) / cellSize;
+    glm::vec3 base = glm::floor(u);
+    glm::vec3 f = u - base;
+    glm::ivec3 i0 = glm::ivec3(base);
+    i0 = ((i0 % r) + r) % r;
+    glm::ivec3 i1 = (i0 + 1) % r;
+
+    const glm::vec3 *v = turbulence.data();
+    glm::vec3 c00 = glm::mix(v[(i0.z * r + i0.y) * r + i0.x], v[(i0.z * r + i0.y) * r + i1.x], f.x);
+    glm::vec3 c10 = glm::mix(v[(i0.z * r + i1.y) * r + i0.x], v[(i0.z * r + i1.y) * r + i1.x], f.x);
+    glm::vec3 c01 = glm::mix(v[(i1.z * r + i0.y) * r + i0.x], v[(i1.z * r + i0.y) * r + i1.x], f.x);
+    glm::vec3 c11 = glm::mix(v[(i1.z * r + i1.y) * r + i0.x], v[(i1.z * r + i1.y) * r + i1.x], f.x);
+    return glm::mix(glm::mix(c00, c10, f.y), glm::mix(c01, c11, f.y), f.z);
+}
+
+// Force of the field at the point x. Gust fronts travel along the wind at
+// gustSpeed, so points downwind see the same gust a little later.
+glm::vec3 ForceField::sample(glm::vec3 x) {
+    glm::vec3 force(0.0f);
+    float speed = glm::length(wind);
+    if (speed > 0.0f) {
+        float t = time;
+        if (gustSpeed > 0.0f)
+            t -= glm::dot(x, wind) / (speed * gustSpeed);
+        force += (gustStrength > 0.0f ? gust(t) : 1.0f) * wind;
+    }
+
+    if (turbulenceStrength > 0.0f && resolution > 0)
+        force += turbulenceStrength * turbulenceAt(x);
+
+    for (auto &e : emitters) {
+        glm::vec3 d = x - e.position;
+        if (e.type == Emitter::Point) {
+            float distance = glm::length(d);
+            if (distance <= 0.0f || distance >= e.radius)
+                continue;
+            float fade = 1.0f - distance / e.radius;
+            force += (e.strength * fade * fade / distance) * d;
+        } else {
+            float along = glm::dot(d, e.direction);
+            float across = glm::length(d - along * e.direction);
+            if (along <= 0.0f || across >= e.radius)
+                continue;
+            float fade = 1.0f - across / e.radius;
+            force += (e.strength * fade * fade) * e.direction;
+        }
+    }
+    return force;
+}
+
+// Force of the field at every particle. Each particle is independent, so
+// the loop is split among the threads; the fixed particles get a force too,
+// which is simply never used.
+void ForceField::sample(std::vector<Particle> &particles, std::vector<glm::vec3> &forces) {
+    int size = static_cast<int>(particles.size());
+    forces.resize(size);
+    #pragma omp parallel for
+    for (int k = 0; k < size; ++k)
+        forces[k] = sample(particles[k].position);
+}
@@ -0,0 +1,82 @@
+#ifndef FORCEFIELD_H
+#define FORCEFIELD_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "particle.h"
+
+// Struct that represents a local source of wind. A point emitter blows away
+// from its position, a directional one blows along its direction inside a
+// cylinder of the given radius that starts at its position. The force fades
+// out quadratically towards the radius.
+struct Emitter {
+    enum Type { Point, Directional };
+    Type type;
+    glm::vec3 position;
+    glm::vec3 direction;
+    float strength;
+    float radius;
+};
+
+// Class responsible for a spatially varying force field sampled at every
+// particle. The force is the sum of a mean wind modulated by gusts, which
+// travel along the wind as fronts, a turbulence volume and the emitters.
+// The turbulence is the curl of a smoothed random vector potential, so it is
+// divergence free and looks like swirling air; it is baked once into a
+// periodic grid that is scrolled along with the wind and read with trilinear
+// interpolation.
+class ForceField {
+    // Velocity samples of the turbulence, resolution^3 of them, with x
+    // varying fastest, and the size of a cell.
+    std::vector<glm::vec3> turbulence;
+    int resolution;
+    float cellSize;
+
+    // Time elapsed since the field was created.
+    float time;
+
+    // Gust factor at time t, a smooth pseudo random signal around 1.
+    float gust(float t);
+
+    // Trilinear lookup of the turbulence at x, wrapping around the grid.
+    glm::vec3 turbulenceAt(glm::vec3 x);
+
+public:
+    // Mean wind force, relative amplitude of the gusts, their mean period
+    // and the speed at which gust fronts travel along the wind.
+    glm::vec3 wind;
+    float gustStrength;
+    float gustPeriod;
+    float gustSpeed;
+
+    // Magnitude of the turbulence force and velocity at which the
+    // turbulence volume is carried.
+    float turbulenceStrength;
+    glm::vec3 turbulenceVelocity;
+
+    std::vector<Emitter> emitters;
+
+    // Constructor responsible for creating an empty field.
+    ForceField();
+
+    // Whether the field adds any force.
+    bool enabled();
+
+    // Bakes the turbulence volume with the given resolution and cell size
+    // from the given seed. The samples have unit mean magnitude.
+    void createTurbulence(int resolution, float cellSize, float strength, unsigned int seed = 1);
+
+    // Adds a point or directional emitter.
+    void addEmitter(Emitter::Type type, glm::vec3 position, glm::vec3 direction, float strength, float radius);
+
+    // Advances the time of the field by h.
+    void advance(float h);
+
+    // Force of the field at the point x.
+    glm::vec3 sample(glm::vec3 x);
+
+    // Force of the field at every particle.
+    void sample(std::vector<Particle> &particles, std::vector<glm::vec3> &forces);
+};
+
+#endif // FORCEFIELD_H
@@ -1,78 +1,566 @@
 #include "genericmesh.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <vector>
 
+// Spreads the lower 10 bits of x so that there are two zero bits
+// between each of them, as needed to interleave three coordinates.
+static uint32_t expandBits(uint32_t x) {
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x << 8)) & 0x0300F00F;
+    x = (x | (x << 4)) & 0x030C30C3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
 // Class that represents a generic mesh. Constains an adjacency
 // list (meshGraph) in which each index has the adjacent particles
 // of particle_list's i_th particle, a list of particles which
 // each index i has a particle, the number of relaxations each
 // bar does per step, the damping coefficient, the force that acts
-// on the mesh and each particle's initial velocity.
+// on the mesh, each particle's initial velocity and whether the
+// particles should be reordered along a space-filling curve.
 GenericMesh::GenericMesh(std::vector<std::vector<int> > &meshGraph,
                          std::vector<Particle> &particle_list,
                          int n_relaxations,
                          float h,
                          float delta,
                          glm::vec3 force = glm::vec3(0.0f),
-                         glm::vec3 initialVelocity = glm::vec3(0.0f)) {
+                         glm::vec3 initialVelocity = glm::vec3(0.0f),
+                         bool reorder)
+    : stepsSinceAdapt(0), density(0.0f), refineAngle(0.0f), refineStrain(0.0f), minLength(0.0f), adaptSteps(0) {
     this->force = force;
     this->n_relaxations = n_relaxations;
     this->h = h;
     this->delta = delta;
     this->force = force;
-    DFS(meshGraph, particle_list);
 
-    for (auto p : particle_list) {
+    int size = static_cast<int>(particle_list.size());
+    if (reorder) {
+        order = mortonOrder(particle_list);
+    } else {
+        order.resize(size);
+        for (int i = 0; i < size; ++i)
+            order[i] = i;
+    }
+    indexOf.resize(size);
+    for (int k = 0; k < size; ++k)
+        indexOf[order[k]] = k;
+
+    // The bars keep references to the stored particles, so the vector
+    // must not reallocate after this point.
+    particles.reserve(size);
+    restPositions.resize(size);
+    for (int k = 0; k < size; ++k) {
+        Particle p = particle_list[order[k]];
+        restPositions[k] = p.position;
         if (!p.isFixed) {
             p.previousPosition = p.position;
             p.position = p.previousPosition + h * initialVelocity;
         }
         this->particles.push_back(p);
     }
+
+    std::vector<std::vector<int> > adj(size);
+    for (int k = 0; k < size; ++k)
+        for (auto v : meshGraph[order[k]])
+            adj[k].push_back(indexOf[v]);
+    for (auto &neighbours : adj) {
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    }
+
+    // Every 3-cycle of the graph is a triangle, found once from its
+    // smallest vertex.
+    for (int k = 0; k < size; ++k)
+        for (auto v : adj[k])
+            if (v > k)
+                for (auto w : adj[k])
+                    if (w > v && std::binary_search(adj[v].begin(), adj[v].end(), w))
+                        triangles.push_back(glm::ivec3(k, v, w));
+    indexTriangles();
+
+    std::vector<std::pair<int, int> > edges;
+    DFS(adj, edges);
+
+    if (reorder) {
+        for (auto &e : edges)
+            if (e.first > e.second)
+                std::swap(e.first, e.second);
+        std::sort(edges.begin(), edges.end());
+    }
+
+    bars.reserve(edges.size());
+    for (auto &e : edges) {
+        glm::vec3 restDirection = particle_list[order[e.first]].position - particle_list[order[e.second]].position;
+        this->bars.push_back(Bar(particles, e.first, e.second, glm::length(restDirection)));
+    }
+}
+
+// Returns the original indices of the particles sorted along a Morton
+// (Z-order) curve of their rest positions. Each coordinate is quantized
+// to 10 bits inside the bounding box of the mesh.
+std::vector<int> GenericMesh::mortonOrder(std::vector<Particle> &particle_list) {
+    int size = static_cast<int>(particle_list.size());
+    std::vector<int> sorted(size);
+    if (size == 0)
+        return sorted;
+
+    glm::vec3 lo = particle_list[0].position;
+    glm::vec3 hi = particle_list[0].position;
+    for (auto &p : particle_list) {
+        lo = glm::min(lo, p.position);
+        hi = glm::max(hi, p.position);
+    }
+    glm::vec3 scale = 1023.0f / glm::max(hi - lo, glm::vec3(1e-6f));
+
+    std::vector<uint32_t> codes(size);
+    for (int i = 0; i < size; ++i) {
+        glm::uvec3 q = glm::uvec3((particle_list[i].position - lo) * scale);
+        codes[i] = (expandBits(q.x) << 2) | (expandBits(q.y) << 1) | expandBits(q.z);
+        sorted[i] = i;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [&codes](int a, int b) { return codes[a] < codes[b]; });
+    return sorted;
 }
 
 // A utility function to do DFS of graph recursively from a given vertex u.
-void GenericMesh::DFSUtil(int u, std::vector<std::vector<int> > &adj, std::vector<Particle> &particles, std::vector<bool> &visited) {
+// Every tree edge becomes a bar, recorded as a pair of particle indices.
+void GenericMesh::DFSUtil(int u, std::vector<std::vector<int> > &adj, std::vector<bool> &visited, std::vector<std::pair<int, int> > &edges) {
     visited[u] = true;
     for (auto v : adj[u]) {
         if (!visited[v]) {
-            float distance = glm::length(particles[u].position - particles[v].position);
-            Bar bar = Bar(particles[u], particles[v], distance);
-            this->bars.push_back(bar);
-
-            DFSUtil(v, adj, particles, visited);
+            edges.push_back({u, v});
+            DFSUtil(v, adj, visited, edges);
         }
     }
 }
 
 // This function does DFSUtil() for all unvisited vertices.
-void GenericMesh::DFS(std::vector<std::vector<int> > &adj, std::vector<Particle> &particles) {
+void GenericMesh::DFS(std::vector<std::vector<int> > &adj, std::vector<std::pair<int, int> > &edges) {
     std::vector<bool> visited(adj.size(), false);
-    for (int v = 0; v < adj.size(); v++)
+    for (int v = 0; v < static_cast<int>(adj.size()); v++)
         if (visited[v] == false)
-            DFSUtil(v, adj, particles, visited);
+            DFSUtil(v, adj, visited, edges);
+}
+
+// Returns the particle with the given index in the original particle list.
+Particle &GenericMesh::particle(int index) {
+    return particles[indexOf[index]];
+}
+
+// Makes the mesh adaptive. Every triangle edge gets a bar, since the bars
+// built by the constructor only cover a spanning tree, and room is reserved
+// for up to capacity particles. When the reservation moves the particles the
+// bars are built again so they point at the new storage.
+void GenericMesh::setAdaptive(float refineAngle, float refineStrain, float minLength, int capacity, int steps) {
+    this->refineAngle = std::max(refineAngle, 0.0f);
+    this->refineStrain = std::max(refineStrain, 0.0f);
+    this->minLength = minLength;
+    this->adaptSteps = steps;
+    stepsSinceAdapt = 0;
+
+    if (capacity > static_cast<int>(particles.capacity())) {
+        particles.reserve(capacity);
+        for (auto &bar : bars) {
+            Bar rebound(particles, bar.index1, bar.index2, bar.length);
+            rebound.compliance = bar.compliance;
+            bar = rebound;
+        }
+    }
+
+    float mass = 0.0f, area = 0.0f;
+    for (auto &p : particles)
+        if (p.isActive)
+            mass += p.mass;
+    for (auto &t : triangles)
+        if (t[0] >= 0)
+            area += restArea(t);
+    density = area > 0.0f ? mass / area : 0.0f;
+
+    barIndex.clear();
+    for (int i = 0; i < static_cast<int>(bars.size()); ++i)
+        barIndex[std::minmax(bars[i].index1, bars[i].index2)] = i;
+    for (auto &t : triangles) {
+        if (t[0] < 0)
+            continue;
+        for (int e = 0; e < 3; ++e) {
+            int a = t[e];
+            int b = t[(e + 1) % 3];
+            if (barIndex.find(std::minmax(a, b)) == barIndex.end())
+                addBar(a, b, 0.0f);
+        }
+    }
+}
+
+// Adds the bar between the particles a and b, with its rest length taken
+// from the rest positions.
+void GenericMesh::addBar(int a, int b, float compliance) {
+    Bar bar(particles, a, b, glm::length(restPositions[a] - restPositions[b]));
+    bar.compliance = compliance;
+    barIndex[std::minmax(a, b)] = static_cast<int>(bars.size());
+    bars.push_back(bar);
+}
+
+// Removes the bar between the particles a and b by moving the last bar into
+// its place. Returns the compliance of the removed bar, or 0 when there was
+// no bar.
+float GenericMesh::removeBar(int a, int b) {
+    auto found = barIndex.find(std::minmax(a, b));
+    if (found == barIndex.end())
+        return 0.0f;
+    int i = found->second;
+    float compliance = bars[i].compliance;
+    barIndex.erase(found);
+    int last = static_cast<int>(bars.size()) - 1;
+    if (i != last) {
+        bars[i] = bars[last];
+        barIndex[std::minmax(bars[i].index1, bars[i].index2)] = i;
+    }
+    bars.pop_back();
+    return compliance;
+}
+
+// Normal of the given triangle for the current positions, or 0 when the
+// triangle is degenerate.
+glm::vec3 GenericMesh::normal(glm::ivec3 triangle) {
+    glm::vec3 n = glm::cross(particles[triangle[1]].position - particles[triangle[0]].position,
+                             particles[triangle[2]].position - particles[triangle[0]].position);
+    float l = glm::length(n);
+    return l > 0.0f ? n / l : glm::vec3(0.0f);
+}
+
+// Largest angle between the normals of any two of the given triangles,
+// compared up to sign. Slots of -1 are skipped.
+float GenericMesh::spread(const int *slots, int count) {
+    glm::vec3 normals[4];
+    int used = 0;
+    for (int i = 0; i < count; ++i)
+        if (slots[i] >= 0)
+            normals[used++] = normal(triangles[slots[i]]);
+    float smallest = 1.0f;
+    for (int i = 0; i < used; ++i)
+        for (int j = i + 1; j < used; ++j)
+            smallest = std::min(smallest, glm::abs(glm::dot(normals[i], normals[j])));
+    return std::acos(smallest);
+}
+
+// Relative elongation of the bar between the particles a and b with respect
+// to their rest positions.
+float GenericMesh::strain(int a, int b) {
+    float rest = restLength(a, b);
+    float current = glm::length(particles[a].position - particles[b].position);
+    return (current - rest) / rest;
+}
+
+// Distance between the particles a and b at rest.
+float GenericMesh::restLength(int a, int b) {
+    return glm::length(restPositions[a] - restPositions[b]);
+}
+
+// Area of the triangle t at rest.
+float GenericMesh::restArea(glm::ivec3 t) {
+    return 0.5f * glm::length(glm::cross(restPositions[t[1]] - restPositions[t[0]],
+                                         restPositions[t[2]] - restPositions[t[0]]));
+}
+
+// Follows the longest edge propagation path: while the edge is shorter than
+// the longest edge of one of its triangles, it moves to that longer edge.
+// The length grows along the path, so it ends, and bisecting only terminal
+// edges keeps the angles of the triangles bounded, where bisecting the
+// flagged edges directly would produce slivers after a few levels.
+bool GenericMesh::terminalEdge(std::pair<int, int> &edge, std::map<std::pair<int, int>, glm::ivec2> &faces,
+                               std::vector<bool> &touched) {
+    for (;;) {
+        glm::ivec2 t = faces[edge];
+        float length = restLength(edge.first, edge.second);
+        bool terminal = true;
+        for (int f = 0; f < 2 && terminal; ++f) {
+            if (t[f] < 0)
+                continue;
+            if (touched[t[f]])
+                return false;
+            glm::ivec3 triangle = triangles[t[f]];
+            for (int e = 0; e < 3; ++e) {
+                int a = triangle[e];
+                int b = triangle[(e + 1) % 3];
+                if (restLength(a, b) > 1.0001f * length) {
+                    edge = std::minmax(a, b);
+                    terminal = false;
+                    break;
+                }
+            }
+        }
+        if (terminal)
+            return true;
+    }
 }
 
+// Splits the edge (a, b) at its midpoint. Each triangle (x, y, c) of the
+// edge becomes (x, p, c) and (p, y, c), keeping its orientation, and the bar
+// (a, b) is replaced by the bars from p to a, b and the opposite vertices.
+// The mass stays lumped by area: each halved triangle moves a sixth of its
+// mass from a and from b to p, at most half of theirs, so the cloth keeps
+// its weight and its distribution.
+bool GenericMesh::split(int a, int b, int t1, int t2) {
+    int p;
+    if (!freeParticles.empty()) {
+        p = freeParticles.back();
+        freeParticles.pop_back();
+    } else if (particles.size() < particles.capacity()) {
+        p = static_cast<int>(particles.size());
+        particles.push_back(particles[a]);
+        restPositions.push_back(glm::vec3(0.0f));
+    } else {
+        return false;
+    }
+
+    restPositions[p] = 0.5f * (restPositions[a] + restPositions[b]);
+    float share = 0.0f;
+    if (t1 >= 0)
+        share += density * restArea(triangles[t1]) / 6.0f;
+    if (t2 >= 0)
+        share += density * restArea(triangles[t2]) / 6.0f;
+
+    EdgeSplit record;
+    record.taken[0] = std::min(share, 0.5f * particles[a].mass);
+    record.taken[1] = std::min(share, 0.5f * particles[b].mass);
+    particles[a].mass -= record.taken[0];
+    particles[a].setFixed(particles[a].isFixed);
+    particles[b].mass -= record.taken[1];
+    particles[b].setFixed(particles[b].isFixed);
+
+    Particle created(record.taken[0] + record.taken[1],
+                     0.5f * (particles[a].position + particles[b].position), false);
+    created.previousPosition = 0.5f * (particles[a].previousPosition + particles[b].previousPosition);
+    particles[p] = created;
+    record.particle = p;
+    record.a = a;
+    record.b = b;
+    record.c = -1;
+    record.d = -1;
+    int faces[2] = { t1, t2 };
+    for (int f = 0; f < 2; ++f) {
+        record.slots[2 * f] = -1;
+        record.slots[2 * f + 1] = -1;
+        record.original[f] = glm::ivec3(-1);
+        if (faces[f] < 0)
+            continue;
+
+        glm::ivec3 t = triangles[faces[f]];
+        int i = 0;
+        while (t[i] == a || t[i] == b)
+            ++i;
+        int c = t[i];
+        int x = t[(i + 1) % 3];
+        int y = t[(i + 2) % 3];
+        (f == 0 ? record.c : record.d) = c;
+
+        int slot;
+        if (!freeTriangles.empty()) {
+            slot = freeTriangles.back();
+            freeTriangles.pop_back();
+        } else {
+            slot = static_cast<int>(triangles.size());
+            triangles.push_back(glm::ivec3(-1));
+        }
+        record.original[f] = t;
+        record.slots[2 * f] = faces[f];
+        record.slots[2 * f + 1] = slot;
+        record.created[2 * f] = triangles[faces[f]] = glm::ivec3(x, p, c);
+        record.created[2 * f + 1] = triangles[slot] = glm::ivec3(p, y, c);
+    }
+
+    float compliance = removeBar(a, b);
+    addBar(a, p, compliance);
+    addBar(p, b, compliance);
+    if (record.c >= 0)
+        addBar(p, record.c, compliance);
+    if (record.d >= 0)
+        addBar(p, record.d, compliance);
+    splits.push_back(record);
+    return true;
+}
+
+// Undoes the given split: the original triangles and the bar (a, b) come
+// back, the mass of the particle goes back to a and b, and the particle and
+// the triangle slots it created are freed.
+void GenericMesh::merge(int s) {
+    EdgeSplit record = splits[s];
+    int p = record.particle;
+    float compliance = removeBar(record.a, p);
+    removeBar(p, record.b);
+    if (record.c >= 0)
+        removeBar(p, record.c);
+    if (record.d >= 0)
+        removeBar(p, record.d);
+    addBar(record.a, record.b, compliance);
+
+    for (int f = 0; f < 2; ++f) {
+        if (record.slots[2 * f] < 0)
+            continue;
+        triangles[record.slots[2 * f]] = record.original[f];
+        triangles[record.slots[2 * f + 1]] = glm::ivec3(-1);
+        freeTriangles.push_back(record.slots[2 * f + 1]);
+    }
+
+    particles[record.a].mass += record.taken[0];
+    particles[record.a].setFixed(particles[record.a].isFixed);
+    particles[record.b].mass += record.taken[1];
+    particles[record.b].setFixed(particles[record.b].isFixed);
+    particles[p].setFixed(true);
+    particles[p].isActive = false;
+    freeParticles.push_back(p);
+    splits.erase(splits.begin() + s);
+}
+
+// Refines and coarsens the mesh once. Splits are undone newest first, and
+// only when the triangles they created are still there, so a split is
+// never undone under a later one. Then every edge whose dihedral angle or
+// strain is too large is refined, most urgent first, by splitting the end
+// of its longest edge propagation path. At most one edge per triangle is
+// split in a pass, so the triangles of a pass never overlap; an edge whose
+// path ended elsewhere is split in a later pass.
+int GenericMesh::adapt() {
+    int changes = 0;
+    for (int s = static_cast<int>(splits.size()) - 1; s >= 0; --s) {
+        EdgeSplit &record = splits[s];
+        bool intact = true;
+        for (int i = 0; i < 4; ++i)
+            if (record.slots[i] >= 0 && triangles[record.slots[i]] != record.created[i])
+                intact = false;
+        if (!intact || (refineAngle > 0.0f && spread(record.slots, 4) > 0.5f * refineAngle))
+            continue;
+        int p = record.particle;
+        float worst = std::max(strain(record.a, p), strain(p, record.b));
+        if (record.c >= 0)
+            worst = std::max(worst, strain(p, record.c));
+        if (record.d >= 0)
+            worst = std::max(worst, strain(p, record.d));
+        if (refineStrain > 0.0f && worst > 0.5f * refineStrain)
+            continue;
+        merge(s);
+        ++changes;
+    }
+
+    std::map<std::pair<int, int>, glm::ivec2> faces;
+    for (int t = 0; t < static_cast<int>(triangles.size()); ++t) {
+        if (triangles[t][0] < 0)
+            continue;
+        for (int e = 0; e < 3; ++e) {
+            auto found = faces.insert({std::minmax(triangles[t][e], triangles[t][(e + 1) % 3]), glm::ivec2(t, -1)});
+            if (!found.second)
+                found.first->second[1] = t;
+        }
+    }
+
+    std::vector<std::pair<float, std::pair<int, int> > > candidates;
+    for (auto &edge : faces) {
+        int a = edge.first.first;
+        int b = edge.first.second;
+        float score = refineStrain > 0.0f ? strain(a, b) / refineStrain : 0.0f;
+        if (refineAngle > 0.0f && edge.second[1] >= 0) {
+            int slots[2] = { edge.second[0], edge.second[1] };
+            score = std::max(score, spread(slots, 2) / refineAngle);
+        }
+        if (score > 1.0f)
+            candidates.push_back({score, edge.first});
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const std::pair<float, std::pair<int, int> > &x,
+                 const std::pair<float, std::pair<int, int> > &y) { return x.first > y.first; });
+
+    std::vector<bool> touched(triangles.size(), false);
+    for (auto &candidate : candidates) {
+        std::pair<int, int> edge = candidate.second;
+        if (!terminalEdge(edge, faces, touched))
+            continue;
+        if (restLength(edge.first, edge.second) <= 2.0f * minLength)
+            continue;
+        glm::ivec2 t = faces[edge];
+        if (!split(edge.first, edge.second, t[0], t[1]))
+            break;
+        touched[t[0]] = true;
+        if (t[1] >= 0)
+            touched[t[1]] = true;
+        ++changes;
+    }
+    return changes;
+}
+
+// Number of particles in use, without the ones freed by coarsening.
+int GenericMesh::activeParticles() {
+    return static_cast<int>(particles.size() - freeParticles.size());
+}
 
 // Receives the step, the damping coefficient and the force that acts on the mesh
-// and calculates the next position of each particle.
+// and calculates the next position of each particle. An adaptive mesh adapts
+// first, every adaptSteps steps.
 void GenericMesh::oneStep(float h, float delta, glm::vec3 force) {
-    for (Particle particle : particles) {
+    if (adaptSteps > 0 && ++stepsSinceAdapt >= adaptSteps) {
+        if (adapt() > 0) {
+            indexTriangles();
+            selfCollision.invalidate();
+            colliders.continuous.invalidate();
+        }
+        stepsSinceAdapt = 0;
+    }
+    sampleForces(h);
+    if (colliders.enabled())
+        colliders.begin(particles);
+
+    if (implicit.enabled()) {
+        stepImplicit(h, delta, force);
+        return;
+    }
+
+    if (projective.enabled() && stepProjective(h, delta, force))
+        return;
+
+    if (springs.enabled()) {
+        stepMassSpring(h, delta, force);
+        return;
+    }
+
+    if (substeps > 0) {
+        stepXPBD(h, delta, force);
+        return;
+    }
+
+    for (int k = 0; k < static_cast<int>(particles.size()); ++k) {
+        Particle &particle = particles[k];
         if (particle.isFixed)
             continue;
         glm::vec3 pos = particle.position;
         glm::vec3 prevPos = particle.previousPosition;
         float mass = particle.mass;
-        pos = pos + (1.0f - delta) * (pos - prevPos) + ((h*h) / mass) * force;
+        glm::vec3 f = forces.empty() ? force : force + forces[k];
+        pos = pos + (1.0f - delta) * (pos - prevPos) + ((h*h) / mass) * f;
         particle.previousPosition = particle.position;
         particle.position = pos;
     }
 
+    bool accelerate = chebyshev.enabled() && !particles.empty();
+    if (accelerate)
+        chebyshev.startStep(static_cast<int>(particles.size()));
+
+    startRelaxation();
     for (int i = 0; i < n_relaxations; ++i) {
+        float error = 0.0f;
         for (auto &bar : bars) {
-            bar.update();
+            error += bar.update(omega);
         }
+        observeRelaxation(error, 1);
+        if (accelerate)
+            chebyshev.finishIteration(chebyshev.accelerate(&particles[0], static_cast<int>(particles.size()), 0));
+        projectColliders(false);
     }
+    finishRelaxation();
+
+    enforceConstraints();
 }
 
 // Implementation of oneStep without receiving paramenters.
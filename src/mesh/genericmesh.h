@@ -1,24 +1,139 @@
+#ifndef GENERICMESH_H
+#define GENERICMESH_H
+
 #include <glm/glm.hpp>
+#include <map>
 #include <vector>
+#include <utility>
 #include "mesh.h"
 
+// Struct that records an edge split of the adaptive refinement: the new
+// particle, the endpoints a and b of the edge, the opposite vertices c and d
+// of its triangles (d is -1 on the border), the mass the new particle took
+// from a and from b, the slots of the triangles it created with their
+// contents, and the triangles it replaced.
+struct EdgeSplit {
+    int particle;
+    int a, b, c, d;
+    float taken[2];
+    int slots[4];
+    glm::ivec3 created[4];
+    glm::ivec3 original[2];
+};
+
 class GenericMesh : public Mesh {
 
-    void DFSUtil(int u, std::vector<std::vector<int> > &adj, std::vector<Particle> &particles, std::vector<bool> &visited);
-    void DFS(std::vector<std::vector<int> > &adj, std::vector<Particle> &particles);
+    void DFSUtil(int u, std::vector<std::vector<int> > &adj, std::vector<bool> &visited, std::vector<std::pair<int, int> > &edges);
+    void DFS(std::vector<std::vector<int> > &adj, std::vector<std::pair<int, int> > &edges);
+
+    // Returns the original indices of the particles sorted along a Morton
+    // (Z-order) curve of their rest positions.
+    std::vector<int> mortonOrder(std::vector<Particle> &particle_list);
+
+    // Splits made by the adaptive refinement that can still be undone,
+    // index of the bar of each edge, free particle and triangle slots and
+    // number of steps since the mesh last adapted.
+    std::vector<EdgeSplit> splits;
+    std::map<std::pair<int, int>, int> barIndex;
+    std::vector<int> freeParticles;
+    std::vector<int> freeTriangles;
+    int stepsSinceAdapt;
+
+    // Mass per unit of rest area of the cloth, measured when the mesh is
+    // made adaptive, used to lump the mass of the split triangles.
+    float density;
+
+    // Adds the bar between the particles a and b with the given compliance
+    // or removes it, keeping barIndex up to date. removeBar returns the
+    // compliance of the removed bar.
+    void addBar(int a, int b, float compliance);
+    float removeBar(int a, int b);
+
+    // Splits the edge (a, b) of the triangles t1 and t2 (-1 on the border)
+    // at its midpoint. Returns false when there is no room for the particle.
+    bool split(int a, int b, int t1, int t2);
+
+    // Undoes the given split if its triangles were not refined further.
+    void merge(int s);
+
+    // Largest angle between the normals of any two of the given triangles.
+    // Triangle orientations are not consistent, so the normals are compared
+    // up to sign.
+    float spread(const int *slots, int count);
+
+    // Normal of the given triangle for the current positions.
+    glm::vec3 normal(glm::ivec3 triangle);
+
+    // Relative elongation of the bar between the particles a and b.
+    float strain(int a, int b);
+
+    // Distance between the particles a and b at rest.
+    float restLength(int a, int b);
+
+    // Area of the triangle t at rest.
+    float restArea(glm::ivec3 t);
+
+    // Follows the longest edge propagation path from the given edge to an
+    // edge that is the longest edge of all its triangles, whose triangles
+    // are stored in faces. Returns false when the path crosses a triangle
+    // already split in this pass.
+    bool terminalEdge(std::pair<int, int> &edge, std::map<std::pair<int, int>, glm::ivec2> &faces,
+                      std::vector<bool> &touched);
 
 public:
 
-    std::vector<Particle> particles;
+    // Mapping between the original particle indices (the ones used by meshGraph
+    // and particle_list) and the storage order: order[k] is the original index
+    // of particles[k] and indexOf[i] is the position of original particle i.
+    std::vector<int> order;
+    std::vector<int> indexOf;
+
+    // Rest position of every particle. The triangles of the mesh are the
+    // 3-cycles of meshGraph; the ones removed by the adaptive refinement are
+    // kept as (-1, -1, -1) until their slot is reused.
+    std::vector<glm::vec3> restPositions;
+
+    // Adaptive refinement: edges whose dihedral angle (in radians) or strain
+    // exceed these are split, as long as they are longer than twice
+    // minLength at rest, and splits whose neighbourhood went below half of
+    // them are undone. A threshold of 0 disables its criterion. The mesh
+    // adapts every adaptSteps steps and is not adaptive when it is 0.
+    float refineAngle;
+    float refineStrain;
+    float minLength;
+    int adaptSteps;
 
-    // Generic mesh constructor
+    // Generic mesh constructor. When reorder is set the particles are stored
+    // along a space-filling curve and the bars are sorted by their first
+    // endpoint, so the relaxation walks memory mostly in order.
     GenericMesh(std::vector<std::vector<int> > &meshGraph,
                 std::vector<Particle> &particle_list,
                 int n_relaxations,
                 float h,
                 float delta,
                 glm::vec3 force,
-                glm::vec3 initialVelocity);
+                glm::vec3 initialVelocity,
+                bool reorder = false);
+
+    // Returns the particle with the given index in the original particle list.
+    Particle &particle(int index);
+
+    // Makes the mesh adaptive. Every triangle edge gets a bar, and room is
+    // reserved for up to capacity particles: the bars point into the
+    // particle vector, so it never grows past the reserved capacity and the
+    // refinement stops when it is full. Particles removed by coarsening
+    // stay in place as fixed, inactive particles without bars until reused,
+    // so the indices of the other particles never change, and the
+    // collisions and bounds skip them. A threshold of 0 disables its
+    // criterion. The tethers must be created again after the mesh adapts.
+    void setAdaptive(float refineAngle, float refineStrain, float minLength, int capacity, int steps = 10);
+
+    // Refines and coarsens the mesh once. Returns the number of splits made
+    // plus the number undone.
+    int adapt();
+
+    // Number of particles in use.
+    int activeParticles();
 
     // Implementation of oneStep without receiving paramenters.
     void oneStep();
@@ -27,3 +142,5 @@ public:
     // and calculates the next position of each particle.
     void oneStep(float h, float delta, glm::vec3 force);
 };
+
+#endif // GENERICMESH_H
@@ -0,0 +1,125 @@
+#include "implicitsolver.h"
+#include <algorithm>
+#include <cmath>
+
+// Constructor responsible for creating a disabled solver.
+ImplicitSolver::ImplicitSolver()
+    : stiffness(0.0f), maxIterations(50), tolerance(1e-4f), iterations(0) { }
+
+// Whether the solver should be used.
+bool ImplicitSolver::enabled() {
+    return stiffness > 0.0f;
+}
+
+// Dot product of two vectors of the conjugate gradient.
+static double dot(std::vector<glm::vec3> &a, std::vector<glm::vec3> &b) {
+    int size = static_cast<int>(a.size());
+    double sum = 0.0;
+    #pragma omp parallel for reduction(+:sum)
+    for (int k = 0; k < size; ++k)
+        sum += glm::dot(a[k], b[k]);
+    return sum;
+}
+
+// Advances the particles one backward Euler step of size h, receiving
+// the damping coefficient, the force that acts on the mesh and the extra
+// force of each particle.
+// The velocities are the ones implied by the Verlet positions. Each bar is a
+// spring of rest length Bar::length whose stiffness block is
+// k (nn^T + max(0, 1 - L/l) (I - nn^T)); the transverse term is dropped for
+// compressed bars so the system stays positive definite. Only the free
+// particles are part of the system, and the velocity change of the previous
+// step is used as starting point since consecutive steps are very similar.
+void ImplicitSolver::step(std::vector<Particle> &particles, std::vector<Bar> &bars,
+                          float h, float delta, glm::vec3 force, std::vector<glm::vec3> &forces) {
+    if (system.changed(particles, bars)) {
+        system.analyze(particles, bars);
+        dv.assign(system.size(), glm::vec3(0.0f));
+    }
+
+    int size = static_cast<int>(particles.size());
+    int count = static_cast<int>(bars.size());
+    int rows = system.size();
+    rhs.resize(rows);
+    residual.resize(rows);
+    direction.resize(rows);
+    product.resize(rows);
+    preconditioner.resize(rows);
+    velocity.resize(size);
+    blocks.resize(count);
+    springForce.resize(count);
+
+    #pragma omp parallel for
+    for (int k = 0; k < size; ++k)
+        velocity[k] = (particles[k].position - particles[k].previousPosition) / h;
+
+    system.fillJacobian(particles);
+    #pragma omp parallel for
+    for (int b = 0; b < count; ++b) {
+        glm::vec3 n = system.jacobianValues[2 * b];
+        float l = system.lengths[b];
+        glm::mat3 nn = glm::outerProduct(n, n);
+        float transverse = std::max(0.0f, 1.0f - bars[b].length / l);
+        blocks[b] = stiffness * (nn + transverse * (glm::mat3(1.0f) - nn));
+        springForce[b] = -stiffness * (l - bars[b].length);
+    }
+
+    // Spring forces are J^T f, the system matrix is M + h^2 K.
+    float h2 = h * h;
+    system.gather(springForce, rhs);
+    system.assemble(matrix, particles, 1.0f, h2, blocks);
+    #pragma omp parallel for
+    for (int r = 0; r < rows; ++r) {
+        int k = system.freeParticles[r];
+        glm::vec3 kv(0.0f);
+        for (int e = system.start[k]; e < system.start[k + 1]; ++e) {
+            int j = system.incident[e];
+            kv += blocks[j / 2] * (velocity[k] - velocity[system.jacobianColumns[j ^ 1]]);
+        }
+        glm::vec3 f = forces.empty() ? force : force + forces[k];
+        rhs[r] = h * (f + rhs[r]) - h2 * kv;
+        preconditioner[r] = glm::inverse(matrix[system.diagonal[r]]);
+    }
+
+    // Preconditioned conjugate gradient, starting from the previous dv.
+    system.multiply(matrix, dv, product);
+    #pragma omp parallel for
+    for (int r = 0; r < rows; ++r) {
+        residual[r] = rhs[r] - product[r];
+        product[r] = preconditioner[r] * residual[r];
+        direction[r] = product[r];
+    }
+    double rz = dot(residual, product);
+    double threshold = tolerance * tolerance * dot(rhs, rhs);
+
+    iterations = 0;
+    while (iterations < maxIterations && dot(residual, residual) > threshold) {
+        system.multiply(matrix, direction, product);
+        double pAp = dot(direction, product);
+        if (pAp <= 0.0)
+            break;
+        float alpha = static_cast<float>(rz / pAp);
+        #pragma omp parallel for
+        for (int r = 0; r < rows; ++r) {
+            dv[r] += alpha * direction[r];
+            residual[r] -= alpha * product[r];
+            product[r] = preconditioner[r] * residual[r];
+        }
+        double rzNext = dot(residual, product);
+        float beta = static_cast<float>(rzNext / rz);
+        rz = rzNext;
+        #pragma omp parallel for
+        for (int r = 0; r < rows; ++r)
+            direction[r] = product[r] + beta * direction[r];
+        ++iterations;
+    }
+
+    #pragma omp parallel for
+    for (int r = 0; r < rows; ++r) {
+        int k = system.freeParticles[r];
+        Particle &p = particles[k];
+        glm::vec3 v = (1.0f - delta) * (velocity[k] + dv[r]);
+        p.previousPosition = p.position;
+        p.position += h * v;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef IMPLICITSOLVER_H
+#define IMPLICITSOLVER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "particle.h"
+#include "bar.h"
+#include "barsystem.h"
+
+// Class responsible for advancing a mesh with backward Euler (Baraff and
+// Witkin 1998). The bars are treated as stiff springs and the linear system
+// (M + h^2 K) dv = h (f + h (-K) v) is solved for the velocity change with a
+// conjugate gradient preconditioned by the 3x3 diagonal blocks.
+class ImplicitSolver {
+    BarSystem system;
+
+    // Stiffness block and spring force magnitude of each bar, the assembled
+    // system matrix and the inverse diagonal block of each row.
+    std::vector<glm::mat3> blocks;
+    std::vector<float> springForce;
+    std::vector<glm::mat3> matrix;
+    std::vector<glm::mat3> preconditioner;
+
+    // Velocity change of the previous step, used as initial guess, the
+    // velocities at the start of the step and the vectors of the conjugate
+    // gradient. All but the velocities have one entry per free particle.
+    std::vector<glm::vec3> dv;
+    std::vector<glm::vec3> velocity;
+    std::vector<glm::vec3> rhs;
+    std::vector<glm::vec3> residual;
+    std::vector<glm::vec3> direction;
+    std::vector<glm::vec3> product;
+
+public:
+    // Spring stiffness of the bars. The solver is disabled when it is 0.
+    float stiffness;
+
+    // Maximum number of conjugate gradient iterations per step and relative
+    // tolerance on the residual.
+    int maxIterations;
+    float tolerance;
+
+    // Number of iterations used by the last solve.
+    int iterations;
+
+    // Constructor responsible for creating a disabled solver.
+    ImplicitSolver();
+
+    // Whether the solver should be used.
+    bool enabled();
+
+    // Advances the particles one backward Euler step of size h, receiving
+    // the damping coefficient, the force that acts on the mesh and the
+    // extra force of each particle, empty when there is none.
+    void step(std::vector<Particle> &particles, std::vector<Bar> &bars,
+              float h, float delta, glm::vec3 force, std::vector<glm::vec3> &forces);
+};
+
+#endif // IMPLICITSOLVER_H
@@ -1,6 +1,417 @@
 #include "mesh.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
 
-// Sets the force that acts on the mesh.
+// Constructor responsible for the default solver settings: plain
+// Gauss-Seidel sweeps without over-relaxation.
+Mesh::Mesh()
+    : omega(1.0f), substeps(0), substepIterations(1), disturbed(false), normalsCurrent(false), autoOmega(false),
+      tuningSteps(0), tuningLogRatio(0.0), tuningSamples(0), baselineRate(0.0), lastError(0.0f), iteration(0) { }
+
+Mesh::~Mesh() { }
+
+// Wakes the part of the mesh around the given particle. A mesh does not
+// sleep unless its subclass says so.
+void Mesh::wakeParticle(int /*k*/) { }
+
+// Implementation of oneStep without receiving paramenters.
+void Mesh::oneStep() {
+    oneStep(this->h, this->delta, this->force);
+}
+
+// Sets the force that acts on the mesh. A different force disturbs the
+// whole mesh, waking any sleeping part of it.
 void Mesh::setForce(glm::vec3 force) {
+    if (force != this->force)
+        this->disturbed = true;
     this->force = force;
 }
+
+// Samples the field and the aerodynamics at every particle and advances the
+// time of the field by h. A field changes every step and moving air pushes
+// a cloth at rest, so both disturb the whole mesh like a new force. The
+// aerodynamics reuse the normals when nothing moved since they were
+// computed, which is the case when the render path asked for them.
+void Mesh::sampleForces(float h) {
+    bool blowing = field.enabled() || (aero.enabled() && aero.airVelocity != glm::vec3(0.0f));
+    if (!field.enabled() && !aero.enabled()) {
+        forces.clear();
+        normalsCurrent = false;
+        return;
+    }
+
+    if (field.enabled()) {
+        field.sample(particles, forces);
+        field.advance(h);
+    } else {
+        forces.assign(particles.size(), glm::vec3(0.0f));
+    }
+
+    if (aero.enabled()) {
+        if (!normalsCurrent)
+            updateNormals();
+        aero.apply(particles, triangles, faceNormals, triangleStart, triangleIncident, h, forces);
+    }
+    normalsCurrent = false;
+    if (blowing)
+        disturbed = true;
+}
+
+// Enables the aerodynamic drag and lift with the given air density,
+// coefficients and air velocity. A density of 0 disables them.
+void Mesh::setAerodynamics(float density, float drag, float lift, glm::vec3 airVelocity) {
+    aero.density = std::max(density, 0.0f);
+    aero.drag = drag;
+    aero.lift = lift;
+    aero.airVelocity = airVelocity;
+}
+
+// Enables the collisions of the cloth with itself. The thickness must be
+// smaller than the distance between particles that are not joined by a bar.
+void Mesh::setSelfCollision(float thickness, float friction, int iterations) {
+    selfCollision.thickness = std::max(thickness, 0.0f);
+    selfCollision.friction = std::min(std::max(friction, 0.0f), 1.0f);
+    selfCollision.iterations = std::max(iterations, 1);
+}
+
+// Sets the distance kept between the cloth and the colliders, updates their
+// bounds and wakes the whole mesh, since a collider may have moved into a
+// sleeping part of it.
+void Mesh::updateColliders(float thickness) {
+    colliders.thickness = std::max(thickness, 0.0f);
+    colliders.updateBounds();
+    disturbed = true;
+}
+
+// Enables the continuous collisions with the triangle colliders.
+void Mesh::setContinuousCollision(int iterations) {
+    colliders.continuous.iterations = std::max(iterations, 0);
+}
+
+// Enforces the tethers and then resolves the collisions, so the collisions
+// have the last word and the cloth never ends a step inside itself or inside
+// a collider. The continuous collisions come before the final projection,
+// which then keeps the particles they moved thickness off the colliders.
+void Mesh::enforceConstraints() {
+    if (!tethers.empty())
+        enforceTethers();
+    if (selfCollision.enabled()) {
+        selfCollision.solve(particles, bars);
+        for (int k : selfCollision.sleeping)
+            wakeParticle(k);
+    }
+    if (colliders.enabled())
+        colliders.sweep(particles, triangles);
+    projectColliders(true);
+}
+
+// Moves the particles out of the colliders, applying their friction when
+// final is set.
+void Mesh::projectColliders(bool final) {
+    if (colliders.enabled())
+        colliders.project(particles, final);
+}
+
+// Builds the triangles around each particle with a counting sort of the
+// triangle corners by particle.
+void Mesh::indexTriangles() {
+    int size = static_cast<int>(particles.size());
+    int count = static_cast<int>(triangles.size());
+    triangleStart.assign(size + 1, 0);
+    for (auto &t : triangles)
+        if (t[0] >= 0)
+            for (int c = 0; c < 3; ++c)
+                triangleStart[t[c] + 1]++;
+    for (int k = 0; k < size; ++k)
+        triangleStart[k + 1] += triangleStart[k];
+
+    triangleIncident.resize(triangleStart[size]);
+    std::vector<int> next(triangleStart.begin(), triangleStart.end() - 1);
+    for (int f = 0; f < count; ++f)
+        if (triangles[f][0] >= 0)
+            for (int c = 0; c < 3; ++c)
+                triangleIncident[next[triangles[f][c]]++] = f;
+    normalsCurrent = false;
+}
+
+// Computes the normals of the triangles and then the normal of every
+// particle from its own triangles, both in parallel without write
+// conflicts. Particles without triangles get a zero normal.
+void Mesh::updateNormals() {
+    int size = static_cast<int>(particles.size());
+    int count = static_cast<int>(triangles.size());
+    faceNormals.resize(count);
+    normals.resize(size);
+
+    #pragma omp parallel for
+    for (int f = 0; f < count; ++f) {
+        glm::ivec3 t = triangles[f];
+        if (t[0] < 0) {
+            faceNormals[f] = glm::vec3(0.0f);
+            continue;
+        }
+        glm::vec3 p = particles[t[0]].position;
+        faceNormals[f] = glm::cross(particles[t[1]].position - p, particles[t[2]].position - p);
+    }
+
+    #pragma omp parallel for
+    for (int k = 0; k < size; ++k) {
+        glm::vec3 sum(0.0f);
+        for (int e = triangleStart[k]; e < triangleStart[k + 1]; ++e)
+            sum += faceNormals[triangleIncident[e]];
+        float length = glm::length(sum);
+        normals[k] = length > 0.0f ? sum / length : glm::vec3(0.0f);
+    }
+    normalsCurrent = true;
+}
+
+// Sets a fixed over-relaxation factor for the relaxation sweeps.
+void Mesh::setOverRelaxation(float omega) {
+    this->omega = std::min(std::max(omega, 0.01f), 1.99f);
+    this->autoOmega = false;
+    this->tuningSteps = 0;
+}
+
+// Estimates the over-relaxation factor during the next steps. They run
+// with omega = 1 while the decay rate of the bar error between sweeps is
+// measured, which is the convergence factor rho of Gauss-Seidel. Omega is
+// then set to the linear optimum for that rate, 2 / (1 + sqrt(1 - rho)).
+// The bars are not linear, so the rate keeps being watched afterwards and
+// omega is pulled back towards 1 whenever it converges slower than plain
+// Gauss-Seidel did.
+void Mesh::tuneOverRelaxation(int steps) {
+    this->omega = 1.0f;
+    this->autoOmega = true;
+    this->tuningSteps = std::max(steps, 1);
+    this->tuningLogRatio = 0.0;
+    this->tuningSamples = 0;
+}
+
+// Called before the first relaxation iteration of a step.
+void Mesh::startRelaxation() {
+    iteration = 0;
+    lastError = 0.0f;
+}
+
+// Receives the total bar error of the last sweep of an iteration made of
+// the given number of sweeps. The first iteration of a step is dominated
+// by the integration and is not used for the estimate.
+void Mesh::observeRelaxation(float error, int sweeps) {
+    if (autoOmega && iteration > 0 && lastError > 0.0f && error > 0.0f) {
+        tuningLogRatio += std::log(error / lastError) / sweeps;
+        tuningSamples++;
+    }
+    lastError = error;
+    iteration++;
+}
+
+// Called after the last relaxation iteration of a step.
+void Mesh::finishRelaxation() {
+    if (!autoOmega || tuningSamples == 0)
+        return;
+    double rate = tuningLogRatio / tuningSamples;
+    tuningLogRatio = 0.0;
+    tuningSamples = 0;
+
+    if (tuningSteps > 0) {
+        // Still measuring plain Gauss-Seidel, accumulate over the steps.
+        tuningLogRatio = rate;
+        tuningSamples = 1;
+        if (--tuningSteps > 0)
+            return;
+        baselineRate = rate;
+        double rho = std::min(std::exp(rate), 0.999);
+        omega = static_cast<float>(2.0 / (1.0 + std::sqrt(1.0 - rho)));
+        omega = std::min(std::max(omega, 1.0f), 1.9f);
+    } else if (rate > baselineRate) {
+        omega = 1.0f + 0.5f * (omega - 1.0f);
+    }
+}
+
+// Creates a tether from every free particle to its nearest fixed particle,
+// measured along the bars at rest. The distances come from a Dijkstra search
+// started at every fixed particle at once, so each particle is reached from
+// the closest one. The tether length is that distance times slack, which is
+// never shorter than the straight distance at rest.
+void Mesh::createTethers(float slack) {
+    int size = static_cast<int>(particles.size());
+    std::vector<int> start(size + 1, 0);
+    for (auto &bar : bars) {
+        start[bar.index1 + 1]++;
+        start[bar.index2 + 1]++;
+    }
+    for (int k = 0; k < size; ++k)
+        start[k + 1] += start[k];
+    std::vector<int> next(start.begin(), start.end() - 1);
+    std::vector<int> neighbour(start[size]);
+    std::vector<float> length(start[size]);
+    for (auto &bar : bars) {
+        neighbour[next[bar.index1]] = bar.index2;
+        length[next[bar.index1]++] = bar.length;
+        neighbour[next[bar.index2]] = bar.index1;
+        length[next[bar.index2]++] = bar.length;
+    }
+
+    typedef std::pair<float, int> entry;
+    std::priority_queue<entry, std::vector<entry>, std::greater<entry> > queue;
+    std::vector<float> distance(size, std::numeric_limits<float>::infinity());
+    std::vector<int> anchor(size, -1);
+    for (int k = 0; k < size; ++k) {
+        if (particles[k].isFixed) {
+            distance[k] = 0.0f;
+            anchor[k] = k;
+            queue.push({0.0f, k});
+        }
+    }
+    while (!queue.empty()) {
+        entry top = queue.top();
+        queue.pop();
+        int u = top.second;
+        if (top.first > distance[u])
+            continue;
+        for (int e = start[u]; e < start[u + 1]; ++e) {
+            int v = neighbour[e];
+            float d = distance[u] + length[e];
+            if (d < distance[v]) {
+                distance[v] = d;
+                anchor[v] = anchor[u];
+                queue.push({d, v});
+            }
+        }
+    }
+
+    tethers.clear();
+    for (int k = 0; k < size; ++k)
+        if (!particles[k].isFixed && anchor[k] >= 0)
+            tethers.push_back({k, anchor[k], slack * distance[k]});
+}
+
+// Pulls every particle that got farther from its anchor than its tether
+// allows back to the tether length. Anchors are fixed and every particle has
+// at most one tether, so the tethers are independent of each other.
+void Mesh::enforceTethers() {
+    int count = static_cast<int>(tethers.size());
+    #pragma omp parallel for
+    for (int t = 0; t < count; ++t) {
+        Particle &p = particles[tethers[t].particle];
+        glm::vec3 direction = p.position - particles[tethers[t].anchor].position;
+        float distance = glm::length(direction);
+        if (distance > tethers[t].length)
+            p.position -= ((distance - tethers[t].length) / distance) * direction;
+    }
+}
+
+// Switches to the XPBD solver with the given number of substeps and
+// iterations per substep, setting the compliance of every bar.
+// Many substeps with a single iteration each converge best for a given
+// amount of work. A substeps of 0 goes back to the classic relaxation.
+void Mesh::setXPBD(int substeps, int iterations, float compliance) {
+    this->substeps = std::max(substeps, 0);
+    if (this->substeps == 0)
+        return;
+    this->substepIterations = std::max(iterations, 1);
+    for (auto &bar : bars)
+        bar.compliance = compliance;
+}
+
+// Advances the mesh one step of size h with the XPBD solver. The velocity
+// implied by the Verlet positions, (position - previousPosition) / h, is
+// integrated with symplectic Euler in substeps of size h / substeps, each
+// one followed by the bar projections with fresh Lagrange multipliers. The
+// damping is spread over the substeps and previousPosition is set back so
+// that it implies the final velocity over a whole step.
+void Mesh::stepXPBD(float h, float delta, glm::vec3 force) {
+    int size = static_cast<int>(particles.size());
+    float hs = h / substeps;
+    float damping = std::pow(1.0f - delta, 1.0f / substeps);
+    velocities.resize(size);
+    startPositions.resize(size);
+
+    #pragma omp parallel for
+    for (int k = 0; k < size; ++k)
+        velocities[k] = (particles[k].position - particles[k].previousPosition) / h;
+
+    for (int s = 0; s < substeps; ++s) {
+        #pragma omp parallel for
+        for (int k = 0; k < size; ++k) {
+            Particle &p = particles[k];
+            startPositions[k] = p.position;
+            if (p.isFixed)
+                continue;
+            glm::vec3 f = forces.empty() ? force : force + forces[k];
+            velocities[k] = damping * velocities[k] + (hs / p.mass) * f;
+            p.position += hs * velocities[k];
+        }
+
+        for (auto &bar : bars)
+            bar.lambda = 0.0f;
+        for (int i = 0; i < substepIterations; ++i) {
+            for (auto &bar : bars) {
+                bar.solve(hs);
+            }
+            projectColliders(false);
+        }
+
+        #pragma omp parallel for
+        for (int k = 0; k < size; ++k)
+            velocities[k] = (particles[k].position - startPositions[k]) / hs;
+    }
+
+    #pragma omp parallel for
+    for (int k = 0; k < size; ++k)
+        particles[k].previousPosition = particles[k].position - h * velocities[k];
+
+    enforceConstraints();
+}
+
+// Switches to the backward Euler integrator, treating the bars as springs
+// with the given stiffness. A stiffness of 0 goes back to the relaxation.
+void Mesh::setImplicit(float stiffness) {
+    implicit.stiffness = std::max(stiffness, 0.0f);
+}
+
+// Advances the mesh one step of size h with the backward Euler integrator.
+// Large steps stay stable, so no relaxation is needed afterwards.
+void Mesh::stepImplicit(float h, float delta, glm::vec3 force) {
+    implicit.step(particles, bars, h, delta, force, forces);
+
+    enforceConstraints();
+}
+
+// Switches to the Projective Dynamics solver with the given bar weight.
+// A weight of 0 goes back to the relaxation.
+void Mesh::setProjectiveDynamics(float weight) {
+    projective.weight = std::max(weight, 0.0f);
+}
+
+// Advances the mesh one step of size h with Projective Dynamics. When the
+// factorization failed nothing moves, and the caller steps with the next
+// enabled solver instead.
+bool Mesh::stepProjective(float h, float delta, glm::vec3 force) {
+    if (!projective.step(particles, bars, h, delta, force, forces, n_relaxations))
+        return false;
+
+    enforceConstraints();
+    return true;
+}
+
+// Switches to the explicit mass-spring integrator, treating the bars as
+// damped springs, with the given number of substeps per step.
+// A stiffness of 0 goes back to the relaxation.
+void Mesh::setMassSpring(float stiffness, float damping, int substeps, SpringSolver::Integrator integrator) {
+    springs.stiffness = std::max(stiffness, 0.0f);
+    springs.damping = std::max(damping, 0.0f);
+    springs.substeps = std::max(substeps, 1);
+    springs.integrator = integrator;
+}
+
+// Advances the mesh one step of size h with the mass-spring integrator.
+void Mesh::stepMassSpring(float h, float delta, glm::vec3 force) {
+    springs.step(particles, bars, h, delta, force, forces);
+
+    enforceConstraints();
+}
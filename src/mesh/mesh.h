@@ -1,28 +1,236 @@
+#ifndef MESH_H
+#define MESH_H
+
 #include <glm/glm.hpp>
 #include <iostream>
 #include <vector>
 #include <set>
+#include "aerodynamics.h"
 #include "bar.h"
+#include "chebyshev.h"
+#include "colliders.h"
+#include "forcefield.h"
+#include "implicitsolver.h"
+#include "projectivedynamics.h"
+#include "selfcollision.h"
+#include "springsolver.h"
+
+// Struct that represents a long-range attachment (tether). The particle
+// may not get farther than length from its anchor, a fixed particle.
+struct Tether {
+    int particle;
+    int anchor;
+    float length;
+};
 
-// Class that represents the mesh. Contains a vector with it's bars,
+// Class that represents the mesh. Contains a vector with it's particles,
+// a vector with it's bars,
 // a set that registers the already existing bars (edge), the force that
 // acts on the mesh, number of relaxations for each bar in one step,
-// the size of the step and the damping coefficient.
+// the size of the step, the damping coefficient, the optional
+// Chebyshev acceleration of the relaxation and the tethers.
 class Mesh {
 public:
+    std::vector<Particle> particles;
     std::vector<Bar> bars;
     glm::vec3 force;
     int n_relaxations;
     float h;
     float delta;
+    Chebyshev chebyshev;
+
+    // Over-relaxation factor applied to every bar correction, in (0, 2).
+    float omega;
+
+    std::vector<Tether> tethers;
+
+    // Spatially varying force added to the force of every particle.
+    ForceField field;
+
+    // Triangles of the surface, used for the normals and the aerodynamics.
+    // Triangles whose first index is negative are unused slots.
+    std::vector<glm::ivec3> triangles;
+
+    // Normal of each triangle, twice its area long, and unit normal of each
+    // particle, the normalized sum of the normals of its triangles. They are
+    // computed by updateNormals, which the render path and the
+    // aerodynamics share.
+    std::vector<glm::vec3> faceNormals;
+    std::vector<glm::vec3> normals;
+
+    // Aerodynamic drag and lift on the triangles, added to the force of
+    // every particle when enabled.
+    Aerodynamics aero;
+
+    // Collisions of the cloth with itself, resolved at the end of every step.
+    SelfCollision selfCollision;
+
+    // Analytic colliders, projected after every relaxation iteration and at
+    // the end of every step.
+    Colliders colliders;
+
+    // Backward Euler integrator, used instead of the relaxation when enabled.
+    ImplicitSolver implicit;
+
+    // Projective Dynamics solver, used instead of the relaxation when enabled.
+    // Runs n_relaxations local/global iterations per step.
+    ProjectiveDynamics projective;
 
-    // Sets the force that acts on the mesh.
+    // Force based mass-spring integrator, used instead of the relaxation
+    // when enabled.
+    SpringSolver springs;
+
+    // Number of XPBD substeps per step and of XPBD iterations per substep.
+    // The classic position based relaxation is used when substeps is 0, and
+    // keeps its own n_relaxations.
+    int substeps;
+    int substepIterations;
+
+    // Constructor responsible for the default solver settings.
+    Mesh();
+
+    virtual ~Mesh();
+
+    // Sets the force that acts on the mesh. A different force disturbs the
+    // whole mesh, waking any sleeping part of it.
     void setForce(glm::vec3 force);
 
+    // Sets a fixed over-relaxation factor for the relaxation sweeps.
+    void setOverRelaxation(float omega);
+
+    // Estimates the over-relaxation factor from the convergence observed
+    // during the next steps, which run without over-relaxation.
+    void tuneOverRelaxation(int steps = 5);
+
+    // Creates a tether from every free particle to its nearest fixed particle,
+    // measured along the bars at rest. The tether length is that distance
+    // times slack. Must be called again whenever the fixed particles change.
+    void createTethers(float slack = 1.0f);
+
+    // Pulls every particle that got farther from its anchor than its tether
+    // allows back to the tether length.
+    void enforceTethers();
+
+    // Switches to the XPBD solver with the given number of substeps and
+    // iterations per substep, setting the compliance of every bar.
+    // A substeps of 0 goes back to the classic relaxation.
+    void setXPBD(int substeps, int iterations, float compliance);
+
+    // Switches to the backward Euler integrator, treating the bars as springs
+    // with the given stiffness. A stiffness of 0 goes back to the relaxation.
+    void setImplicit(float stiffness);
+
+    // Switches to the Projective Dynamics solver with the given bar weight.
+    // A weight of 0 goes back to the relaxation.
+    void setProjectiveDynamics(float weight);
+
+    // Switches to the explicit mass-spring integrator, treating the bars as
+    // damped springs, with the given number of substeps per step.
+    // A stiffness of 0 goes back to the relaxation.
+    void setMassSpring(float stiffness, float damping, int substeps,
+                       SpringSolver::Integrator integrator = SpringSolver::SymplecticEuler);
+
+    // Enables the aerodynamic drag and lift with the given air density,
+    // coefficients and air velocity. A density of 0 disables them.
+    void setAerodynamics(float density, float drag, float lift, glm::vec3 airVelocity = glm::vec3(0.0f));
+
+    // Enables the collisions of the cloth with itself, keeping the particles
+    // thickness apart, with the given friction and iterations per step.
+    // A thickness of 0 disables them.
+    void setSelfCollision(float thickness, float friction = 0.0f, int iterations = 1);
+
+    // Sets the distance kept between the cloth and the colliders, and must be
+    // called after adding or moving colliders: it updates their bounds and
+    // wakes the whole mesh. The triangle mesh colliders are ignored by the
+    // projection when it is 0.
+    void updateColliders(float thickness);
+
+    // Enables the continuous collisions with the triangle colliders, with
+    // the given maximum number of conservative advancement iterations.
+    // An iterations of 0 disables them.
+    void setContinuousCollision(int iterations = 20);
+
+    // Computes the normals of the triangles and of the particles for the
+    // current positions. The next step reuses them for the aerodynamics,
+    // since the positions it starts from are these.
+    void updateNormals();
+
+    // Wakes the part of the mesh around the given particle, for instance
+    // after a collision moved it. Meshes that never sleep ignore it.
+    virtual void wakeParticle(int k);
+
     // Implementation of oneStep without receiving paramenters.
     void oneStep();
 
     // Receives the step, the damping coefficient and the force that acts on the mesh
     // and calculates the next position of each particle.
-    void oneStep(float h, float delta, glm::vec3 force);
+    virtual void oneStep(float h, float delta, glm::vec3 force) = 0;
+
+protected:
+    // Whether the force changed since the last step.
+    bool disturbed;
+
+    std::vector<glm::vec3> velocities;
+    std::vector<glm::vec3> startPositions;
+
+    // Force of the field and the aerodynamics at every particle for the
+    // current step, empty when both are disabled.
+    std::vector<glm::vec3> forces;
+
+    // Triangles around each particle, those of particle k being
+    // triangleIncident[triangleStart[k]] to
+    // triangleIncident[triangleStart[k + 1] - 1].
+    std::vector<int> triangleStart;
+    std::vector<int> triangleIncident;
+
+    // Whether the normals match the current positions.
+    bool normalsCurrent;
+
+    // Builds the triangles around each particle. Must be called whenever
+    // the triangles change.
+    void indexTriangles();
+
+    // Samples the field and the aerodynamics at every particle and advances
+    // the time of the field by h.
+    void sampleForces(float h);
+
+    // Enforces the tethers and resolves the collisions at the end of a step.
+    void enforceConstraints();
+
+    // Moves the particles out of the colliders, applying their friction
+    // when final is set.
+    void projectColliders(bool final);
+
+    // Advances the mesh one step of size h with the XPBD solver.
+    void stepXPBD(float h, float delta, glm::vec3 force);
+
+    // Advances the mesh one step of size h with the backward Euler integrator.
+    void stepImplicit(float h, float delta, glm::vec3 force);
+
+    // Advances the mesh one step of size h with Projective Dynamics. Returns
+    // false, without advancing, when its system could not be factorized.
+    bool stepProjective(float h, float delta, glm::vec3 force);
+
+    // Advances the mesh one step of size h with the mass-spring integrator.
+    void stepMassSpring(float h, float delta, glm::vec3 force);
+
+    bool autoOmega;
+    int tuningSteps;
+    double tuningLogRatio;
+    int tuningSamples;
+    double baselineRate;
+    float lastError;
+    int iteration;
+
+    // Called before the first relaxation iteration of a step.
+    void startRelaxation();
+
+    // Receives the total bar error of the last sweep of an iteration made
+    // of the given number of sweeps.
+    void observeRelaxation(float error, int sweeps);
+
+    // Called after the last relaxation iteration of a step.
+    void finishRelaxation();
 };
+
+#endif // MESH_H
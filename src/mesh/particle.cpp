@@ -4,6 +4,14 @@
 // Constructor responsible for creating the particles in each bar's end.
 // Contains each particles mass, a 3 coordinate vector that contains
 // its position and a boolean that indicates whether that particle is
-// fixed or not.
+// fixed or not. Every particle starts active.
 Particle::Particle(float mass, glm::vec3 position, bool isFixed) 
-    : mass(mass), position(position), isFixed(isFixed) { }
+    : mass(mass), previousPosition(position), position(position), isFixed(isFixed), isActive(true),
+      inverseMass(isFixed ? 0.0f : 1.0f / mass) { }
+
+// Fixes or releases the particle, keeping its inverse mass consistent.
+// A fixed particle behaves as if it had infinite mass.
+void Particle::setFixed(bool isFixed) {
+    this->isFixed = isFixed;
+    this->inverseMass = isFixed ? 0.0f : 1.0f / mass;
+}
@@ -1,14 +1,26 @@
+#ifndef PARTICLE_H
+#define PARTICLE_H
+
 #include <glm/glm.hpp>
 
 // Struct respsonsible for representing the particle. Contains
 // it's mass, a vector with the previous position of the particle
-// a vector with it's current position and a boolean that indicates
-// wheter it is fixed or not.
+// a vector with it's current position, a boolean that indicates
+// wheter it is fixed or not, one that indicates whether it is part
+// of the cloth, false for the free slots of an adaptive mesh, and
+// the inverse of its mass, which is zero for fixed particles.
 struct Particle {
     float mass;
     glm::vec3 previousPosition;
     glm::vec3 position;
     bool isFixed;
+    bool isActive;
+    float inverseMass;
 
     Particle(float mass, glm::vec3 position, bool isFixed);
+
+    // Fixes or releases the particle, keeping its inverse mass consistent.
+    void setFixed(bool isFixed);
 };
+
+#endif // PARTICLE_H
@@ -0,0 +1,89 @@
+#include "projectivedynamics.h"
+
+// Constructor responsible for creating a disabled solver.
+ProjectiveDynamics::ProjectiveDynamics()
+    : factoredH(0.0f), factoredWeight(0.0f), factored(false), weight(0.0f) { }
+
+// Whether the solver should be used.
+bool ProjectiveDynamics::enabled() {
+    return weight > 0.0f;
+}
+
+// Fills the values of the system, M/h^2 + w L over the free particles, and
+// factorizes it. The state is recorded even when the factorization fails, so
+// a failing system is not factorized again every step until it changes.
+void ProjectiveDynamics::factorize(std::vector<Particle> &particles, float h) {
+    system.assemble(values, particles, 1.0f / (h * h), weight);
+    factoredH = h;
+    factoredWeight = weight;
+    factored = cholesky.factorize(values);
+}
+
+// Advances the particles one step of size h, receiving the damping
+// coefficient, the force that acts on the mesh, the extra force of each
+// particle and the number of local/global iterations. The inertial target y is the same Verlet
+// prediction used by the relaxation. The pattern is only analyzed again when
+// the fixed particles or the bars changed, and the factorization is only
+// redone when, in addition, h or the weight changed. Nothing is done when
+// the factorization failed, so the caller can fall back to another solver.
+bool ProjectiveDynamics::step(std::vector<Particle> &particles, std::vector<Bar> &bars,
+                              float h, float delta, glm::vec3 force, std::vector<glm::vec3> &forces,
+                              int iterations) {
+    if (system.changed(particles, bars)) {
+        system.analyze(particles, bars);
+        cholesky.analyze(system.size(), system.rowStart, system.columns);
+        factorize(particles, h);
+    } else if (h != factoredH || weight != factoredWeight) {
+        factorize(particles, h);
+    }
+    if (!factored)
+        return false;
+
+    int count = system.size();
+    int barCount = static_cast<int>(bars.size());
+    inertia.resize(count);
+    base.resize(count);
+    targets.resize(barCount);
+
+    #pragma omp parallel for
+    for (int r = 0; r < count; ++r) {
+        int k = system.freeParticles[r];
+        Particle &p = particles[k];
+        glm::vec3 pos = p.position;
+        glm::vec3 f = forces.empty() ? force : force + forces[k];
+        inertia[r] = pos + (1.0f - delta) * (pos - p.previousPosition) + ((h*h) / p.mass) * f;
+        p.previousPosition = pos;
+        p.position = inertia[r];
+
+        // Fixed neighbours do not move during the step, so their part of
+        // the right hand side is computed once.
+        glm::vec3 b = (p.mass / (h * h)) * inertia[r];
+        for (int e = system.start[k]; e < system.start[k + 1]; ++e) {
+            int other = system.jacobianColumns[system.incident[e] ^ 1];
+            if (system.row[other] < 0)
+                b += weight * particles[other].position;
+        }
+        base[r] = b;
+    }
+
+    for (int b = 0; b < barCount; ++b)
+        targets[b] = weight * bars[b].length;
+
+    for (int i = 0; i < iterations; ++i) {
+        // Local step: the closest configuration of each bar with its rest
+        // length is length * n, so the sum of w A^T p is J^T (w length).
+        system.fillJacobian(particles);
+        system.gather(targets, rhs);
+
+        // Global step.
+        #pragma omp parallel for
+        for (int r = 0; r < count; ++r)
+            rhs[r] += base[r];
+        cholesky.solve(rhs);
+
+        #pragma omp parallel for
+        for (int r = 0; r < count; ++r)
+            particles[system.freeParticles[r]].position = rhs[r];
+    }
+    return true;
+}
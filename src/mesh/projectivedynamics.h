@@ -0,0 +1,59 @@
+#ifndef PROJECTIVEDYNAMICS_H
+#define PROJECTIVEDYNAMICS_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "particle.h"
+#include "bar.h"
+#include "barsystem.h"
+#include "sparsecholesky.h"
+
+// Class responsible for advancing a mesh with Projective Dynamics (Bouaziz
+// et al. 2014). Every iteration projects each bar to its rest length (local
+// step) and then solves (M/h^2 + w L) x = M y/h^2 + w sum A^T p for the free
+// particles (global step). The matrix only depends on the topology, the
+// masses, the fixed particles and h, so it is factorized once and every
+// global step is just a pair of sparse triangular solves.
+class ProjectiveDynamics {
+    BarSystem system;
+    SparseCholesky cholesky;
+
+    // Values of the system matrix, in the pattern of the bar system.
+    std::vector<double> values;
+
+    // State the factorization was computed for, and whether it succeeded.
+    float factoredH;
+    float factoredWeight;
+    bool factored;
+
+    // Inertial target, constant part of the right hand side, bar targets of
+    // the local step and right hand side of the global step.
+    std::vector<glm::vec3> inertia;
+    std::vector<glm::vec3> base;
+    std::vector<float> targets;
+    std::vector<glm::vec3> rhs;
+
+    // Fills the values of the system and factorizes it, recording whether
+    // the factorization succeeded.
+    void factorize(std::vector<Particle> &particles, float h);
+
+public:
+    // Weight of the bar constraints. The solver is disabled when it is 0.
+    float weight;
+
+    // Constructor responsible for creating a disabled solver.
+    ProjectiveDynamics();
+
+    // Whether the solver should be used.
+    bool enabled();
+
+    // Advances the particles one step of size h, receiving the damping
+    // coefficient, the force that acts on the mesh, the extra force of each
+    // particle, empty when there is none, and the number of local/global
+    // iterations. Returns false, leaving the particles untouched, when the
+    // system could not be factorized.
+    bool step(std::vector<Particle> &particles, std::vector<Bar> &bars,
+              float h, float delta, glm::vec3 force, std::vector<glm::vec3> &forces, int iterations);
+};
+
+#endif // PROJECTIVEDYNAMICS_H
@@ -1,4 +1,6 @@
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <vector>
 #include "rectangularmesh.h"
@@ -13,12 +15,14 @@ bool RectangularMesh::inBounds(int n, int m, int i, int j) {
 // Receives two pairs of coordinates ( (n, m) and (i, j) ) and checks
 // whether an edge with those already exists.
 // Edges are used to avoid creating two identical bars.
-void RectangularMesh::createBarIfNotExist(int n, int m, int i, int j, int k, int l) {
+// The first row touched by each new bar is recorded in barRows.
+void RectangularMesh::createBarIfNotExist(int n, int m, int i, int j, int k, int l, std::vector<int> &barRows) {
     edge e = {{i, j}, {k, l}};
     if (inBounds(n, m, k, l) && edges.find(e) == edges.end()) {
-        float distance = glm::length(particles[i][j].position - particles[k][l].position);
-        Bar bar = Bar(particles[i][j], particles[k][l], distance);
+        float distance = glm::length(particles[i*m + j].position - particles[k*m + l].position);
+        Bar bar = Bar(particles, i*m + j, k*m + l, distance);
         this->bars.push_back(bar);
+        barRows.push_back(std::min(i, k));
         edges.insert(e);
     }
 }
@@ -35,7 +39,7 @@ RectangularMesh::RectangularMesh(int n, int m,
                                  glm::vec3 force = glm::vec3(0.0f),
                                  glm::vec3 initialVelocity = glm::vec3(0.0f)) {
     Particle p = Particle(mass, glm::vec3(0.0f), false);
-    particles.assign(n, std::vector<Particle>(m, p));
+    particles.assign(n * m, p);
     this->force = force;
     this->n = n;
     this->m = m;
@@ -43,69 +47,527 @@ RectangularMesh::RectangularMesh(int n, int m,
     this->h = h;
     this->delta = delta;
     this->force = force;
+    this->tileRows = 0;
+    this->tileSweeps = 0;
+    this->barLength = barLength;
+    this->coarseSweeps = 0;
+    this->regionRows = 0;
+    this->sleepSpeed = 1e-3f;
+    this->sleepError = 1e-3f;
+    this->sleepSteps = 30;
 
     glm::vec3 initialPosition = glm::vec3(-(0.5f * (n-1.0f)) * (barLength), -(0.5f * (m-1.0f)) * (barLength), 0.0f);
 
     for (int i = 0; i < n; ++i) {
         for (int j = 0; j < m; ++j) {
-            particles[0][j].isFixed = true;
-            particles[i][j].previousPosition = initialPosition + glm::vec3((1.0f * i) * (barLength),
-                                                                           (1.0f * j) * (barLength),
-                                                                           0.0f );
-            if (particles[i][j].isFixed) {
-                particles[i][j].position = particles[i][j].previousPosition;
+            particles[j].setFixed(true);
+            particles[i*m + j].previousPosition = initialPosition + glm::vec3((1.0f * i) * (barLength),
+                                                                              (1.0f * j) * (barLength),
+                                                                              0.0f );
+            if (particles[i*m + j].isFixed) {
+                particles[i*m + j].position = particles[i*m + j].previousPosition;
             } else {
-                particles[i][j].position = particles[i][j].previousPosition + h*initialVelocity;
+                particles[i*m + j].position = particles[i*m + j].previousPosition + h*initialVelocity;
             }
         }
     }
 
+    std::vector<int> barRows;
     for (int i = 0; i < n; ++i) {
         for (int j = 0; j < m; ++j) {
-            createBarIfNotExist(n, m, i, j, i-1, j); // north
-            createBarIfNotExist(n, m, i, j, i-1, j+1); // northeast
-            createBarIfNotExist(n, m, i, j, i, j+1); // east
-            createBarIfNotExist(n, m, i, j, i+1, j+1); // southeast
-            createBarIfNotExist(n, m, i, j, i+1, j); // south
-            createBarIfNotExist(n, m, i, j, i+1, j-1); // southwest
-            createBarIfNotExist(n, m, i, j, i, j-1); // west
-            createBarIfNotExist(n, m, i, j, i-1, j-1); // west
+            createBarIfNotExist(n, m, i, j, i-1, j, barRows); // north
+            createBarIfNotExist(n, m, i, j, i-1, j+1, barRows); // northeast
+            createBarIfNotExist(n, m, i, j, i, j+1, barRows); // east
+            createBarIfNotExist(n, m, i, j, i+1, j+1, barRows); // southeast
+            createBarIfNotExist(n, m, i, j, i+1, j, barRows); // south
+            createBarIfNotExist(n, m, i, j, i+1, j-1, barRows); // southwest
+            createBarIfNotExist(n, m, i, j, i, j-1, barRows); // west
+            createBarIfNotExist(n, m, i, j, i-1, j-1, barRows); // west
 
-            createBarIfNotExist(n, m, i, j, i-2, j); // north
-            createBarIfNotExist(n, m, i, j, i-2, j+2); // northeast
-            createBarIfNotExist(n, m, i, j, i, j+2); // east
-            createBarIfNotExist(n, m, i, j, i+2, j+2); // southeast
-            createBarIfNotExist(n, m, i, j, i+2, j); // south
-            createBarIfNotExist(n, m, i, j, i+2, j-2); // southwest
-            createBarIfNotExist(n, m, i, j, i, j-2); // west
-            createBarIfNotExist(n, m, i, j, i-2, j-2); // west
+            createBarIfNotExist(n, m, i, j, i-2, j, barRows); // north
+            createBarIfNotExist(n, m, i, j, i-2, j+2, barRows); // northeast
+            createBarIfNotExist(n, m, i, j, i, j+2, barRows); // east
+            createBarIfNotExist(n, m, i, j, i+2, j+2, barRows); // southeast
+            createBarIfNotExist(n, m, i, j, i+2, j, barRows); // south
+            createBarIfNotExist(n, m, i, j, i+2, j-2, barRows); // southwest
+            createBarIfNotExist(n, m, i, j, i, j-2, barRows); // west
+            createBarIfNotExist(n, m, i, j, i-2, j-2, barRows); // west
         }
     }
+
+    // Sort the bars by their first row, keeping the creation order inside
+    // each row, so every band of rows owns a contiguous range of bars.
+    rowBars.assign(n + 1, 0);
+    for (int row : barRows)
+        rowBars[row + 1]++;
+    for (int i = 0; i < n; ++i)
+        rowBars[i + 1] += rowBars[i];
+
+    std::vector<int> sorted(bars.size());
+    std::vector<int> next(rowBars.begin(), rowBars.end() - 1);
+    for (int b = 0; b < static_cast<int>(bars.size()); ++b)
+        sorted[next[barRows[b]]++] = b;
+
+    std::vector<Bar> rowOrder;
+    rowOrder.reserve(bars.size());
+    for (int b : sorted)
+        rowOrder.push_back(bars[b]);
+    bars = std::move(rowOrder);
+
+    // Two triangles per cell, split along the same diagonal as the render
+    // path, so the normals of the particles match the rendered ones.
+    for (int i = 0; i + 1 < n; ++i) {
+        for (int j = 0; j + 1 < m; ++j) {
+            int k = i*m + j;
+            triangles.push_back(glm::ivec3(k, k + 1, k + m + 1));
+            triangles.push_back(glm::ivec3(k, k + m + 1, k + m));
+        }
+    }
+    indexTriangles();
+}
+
+// Enables the tiled relaxation. The mesh is split in bands of rows small
+// enough for their particles and bars to fit in cacheBytes, and each band
+// relaxes tileSweeps times while it is in cache. Corrections only cross
+// band boundaries between passes, so larger bands and fewer sweeps per
+// pass stay closer to the untiled result. A tileSweeps of 0 disables tiling.
+void RectangularMesh::setTiling(int tileSweeps, int cacheBytes) {
+    if (tileSweeps <= 0) {
+        this->tileRows = 0;
+        this->tileSweeps = 0;
+        return;
+    }
+    int bytesPerRow = static_cast<int>(m * sizeof(Particle) + (bars.size() / n) * sizeof(Bar));
+    // Bars reach two rows down, so bands need at least two rows for
+    // alternate bands to never touch the same particles.
+    this->tileRows = std::max(2, cacheBytes / std::max(bytesPerRow, 1));
+    this->tileSweeps = tileSweeps;
+}
+
+// Enables the multigrid relaxation with up to the given number of coarse
+// levels, each one half the resolution of the previous one. The coarse bars
+// join each node to its east, south and diagonal neighbours, with the rest
+// length of the flat mesh. Coarsening stops when a level would have fewer
+// than three rows or columns.
+void RectangularMesh::setMultigrid(int levels, int coarseSweeps) {
+    this->levels.clear();
+    this->coarseSweeps = levels > 0 ? std::max(coarseSweeps, 1) : 0;
+    for (int stride = 2; static_cast<int>(this->levels.size()) < levels; stride *= 2) {
+        GridLevel grid;
+        grid.stride = stride;
+        grid.rows = (n - 1) / stride + 1;
+        grid.columns = (m - 1) / stride + 1;
+        if (grid.rows < 3 || grid.columns < 3)
+            break;
+
+        const int offsets[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        for (int i = 0; i < grid.rows; ++i) {
+            for (int j = 0; j < grid.columns; ++j) {
+                for (auto &offset : offsets) {
+                    int k = i + offset[0];
+                    int l = j + offset[1];
+                    if (!inBounds(grid.rows, grid.columns, k, l))
+                        continue;
+                    float length = stride * barLength * std::sqrt(float(offset[0]*offset[0] + offset[1]*offset[1]));
+                    grid.bars.push_back(Bar(particles, (i*stride)*m + j*stride, (k*stride)*m + l*stride, length));
+                }
+            }
+        }
+        grid.saved.resize(grid.rows * grid.columns);
+        grid.corrections.resize(grid.rows * grid.columns);
+        this->levels.push_back(std::move(grid));
+    }
+    if (this->levels.empty())
+        this->coarseSweeps = 0;
+}
+
+// Relaxes the bars of the given coarse level the given number of times.
+// The coarse bars only limit the stretch: their length is the flat one, so
+// pushing their nodes apart as well would unfold the cloth and add a
+// bending stiffness the fine bars do not have.
+void RectangularMesh::relaxLevel(GridLevel &grid, int sweeps) {
+    for (int s = 0; s < sweeps; ++s) {
+        for (auto &bar : grid.bars) {
+            bar.limit();
+        }
+    }
+}
+
+// Stores the positions of the nodes of the given coarse level. The coarse
+// nodes are fine particles, so restriction is just injection.
+void RectangularMesh::saveLevel(GridLevel &grid) {
+    #pragma omp parallel for
+    for (int i = 0; i < grid.rows; ++i) {
+        for (int j = 0; j < grid.columns; ++j) {
+            grid.saved[i*grid.columns + j] = particles[(i*grid.stride)*m + j*grid.stride].position;
+        }
+    }
+}
+
+// Runs a V-cycle from the given coarse level down to the coarsest one:
+// relax, solve the coarser levels, interpolate their correction, relax again.
+void RectangularMesh::vCycle(int level) {
+    GridLevel &grid = levels[level];
+    relaxLevel(grid, coarseSweeps);
+    if (level + 1 < static_cast<int>(levels.size())) {
+        saveLevel(levels[level + 1]);
+        vCycle(level + 1);
+        prolongate(level + 1);
+    }
+    relaxLevel(grid, coarseSweeps);
+}
+
+// Interpolates the corrections of the given coarse level to the nodes of the
+// next finer level, or to every particle for the first level. The nodes that
+// are also coarse nodes already moved; the others receive the bilinear
+// interpolation of the corrections of the coarse nodes around them, or the
+// nearest ones along the last row or column when the grid has even size.
+// Fixed particles are never moved.
+void RectangularMesh::prolongate(int level) {
+    GridLevel &coarse = levels[level];
+    int stride = coarse.stride / 2;
+    int rows = level == 0 ? n : levels[level - 1].rows;
+    int columns = level == 0 ? m : levels[level - 1].columns;
+
+    #pragma omp parallel for
+    for (int i = 0; i < coarse.rows; ++i) {
+        for (int j = 0; j < coarse.columns; ++j) {
+            int c = i*coarse.columns + j;
+            coarse.corrections[c] = particles[(i*coarse.stride)*m + j*coarse.stride].position - coarse.saved[c];
+        }
+    }
+
+    #pragma omp parallel for
+    for (int a = 0; a < rows; ++a) {
+        int i = a / 2;
+        int k = std::min(i + 1, coarse.rows - 1);
+        float s = (a % 2 == 1 && i + 1 < coarse.rows) ? 0.5f : 0.0f;
+        for (int b = 0; b < columns; ++b) {
+            if (a % 2 == 0 && b % 2 == 0)
+                continue;
+            Particle &p = particles[(a*stride)*m + b*stride];
+            if (p.isFixed)
+                continue;
+            int j = b / 2;
+            int l = std::min(j + 1, coarse.columns - 1);
+            float t = (b % 2 == 1 && j + 1 < coarse.columns) ? 0.5f : 0.0f;
+            p.position += (1.0f - s) * (1.0f - t) * coarse.corrections[i*coarse.columns + j]
+                        + s * (1.0f - t) * coarse.corrections[k*coarse.columns + j]
+                        + (1.0f - s) * t * coarse.corrections[i*coarse.columns + l]
+                        + s * t * coarse.corrections[k*coarse.columns + l];
+        }
+    }
+}
+
+// Relaxes the bars owned by rows [begin, end) the given number of times.
+// The bars of sleeping regions are skipped, except for the ones of their last
+// two rows when the next region is awake: those bars hold the awake region,
+// and only move its particles since the sleeping ones have no inverse mass.
+// Returns the bar error found by the last sweep.
+float RectangularMesh::relaxRows(int begin, int end, int sweeps) {
+    float error = 0.0f;
+    for (int s = 0; s < sweeps; ++s) {
+        error = 0.0f;
+        for (int i = begin; i < end; ) {
+            int stop = end;
+            int first = i;
+            if (regionRows > 0) {
+                int regionEnd = std::min(n, (i / regionRows + 1) * regionRows);
+                stop = std::min(end, regionEnd);
+                if (asleep[i / regionRows])
+                    first = regionEnd < n && !rowAsleep(regionEnd) ? std::max(i, regionEnd - 2) : stop;
+            }
+            for (int b = rowBars[first]; b < rowBars[stop]; ++b) {
+                error += bars[b].update(omega);
+            }
+            i = stop;
+        }
+    }
+    return error;
+}
+
+// Runs the given number of sweeps tile by tile. The bars of a band also move
+// the first two rows of the next band, so even bands are relaxed first, in
+// parallel, and then odd bands. Bands running at the same time never share
+// a particle and the result does not depend on the number of threads.
+// Returns the bar error found by the last sweep of each tile.
+float RectangularMesh::relaxTiled(int sweeps) {
+    int tiles = (n + tileRows - 1) / tileRows;
+    float error = 0.0f;
+    for (int done = 0; done < sweeps; done += tileSweeps) {
+        int pass = std::min(tileSweeps, sweeps - done);
+        error = 0.0f;
+        for (int parity = 0; parity < 2; ++parity) {
+            #pragma omp parallel for schedule(dynamic) reduction(+:error)
+            for (int t = parity; t < tiles; t += 2) {
+                error += relaxRows(t * tileRows, std::min(n, (t + 1) * tileRows), pass);
+            }
+        }
+    }
+    return error;
+}
+
+// Moves the particles of row i to their predicted position, unless the row
+// is asleep.
+void RectangularMesh::integrateRow(int i, float h, float delta, glm::vec3 force) {
+    if (rowAsleep(i))
+        return;
+    for (int j = 0; j < m; ++j) {
+        if (particles[i*m + j].isFixed)
+            continue;
+        glm::vec3 pos = particles[i*m + j].position;
+        glm::vec3 prevPos = particles[i*m + j].previousPosition;
+        float mass = particles[i*m + j].mass;
+        glm::vec3 f = forces.empty() ? force : force + forces[i*m + j];
+        pos = pos + (1.0f - delta) * (pos - prevPos) + ((h*h) / mass) * f;
+        particles[i*m + j].previousPosition = particles[i*m + j].position;
+        particles[i*m + j].position = pos;
+    }
 }
 
 // Receives the step, the damping coefficient and the force that acts on the mesh
 // and calculates the next position of each particle.
+// The first relaxation sweep is fused with the integration: the bars of a row
+// reach at most two rows down, so as soon as row i is integrated the bars of
+// row i-2 can be relaxed while both rows are still in cache. The result is
+// the same as integrating everything first, but the particles are streamed
+// through memory one time less per step.
 void RectangularMesh::oneStep(float h, float delta, glm::vec3 force) {
+    bool relaxation = !implicit.enabled() && !projective.enabled() && !springs.enabled() && substeps <= 0;
+    sampleForces(h);
+    if (colliders.enabled())
+        colliders.begin(particles);
+    if (regionRows > 0) {
+        if (disturbed || !relaxation)
+            wakeAll();
+        for (int r = 0; r < static_cast<int>(asleep.size()); ++r)
+            simulated[r] = !asleep[r];
+    }
+    disturbed = false;
+
+    if (implicit.enabled()) {
+        stepImplicit(h, delta, force);
+        return;
+    }
+
+    if (projective.enabled() && stepProjective(h, delta, force))
+        return;
+
+    if (springs.enabled()) {
+        stepMassSpring(h, delta, force);
+        return;
+    }
+
+    if (substeps > 0) {
+        stepXPBD(h, delta, force);
+        return;
+    }
+
+    if (n_relaxations <= 0) {
+        for (int i = 0; i < n; ++i)
+            integrateRow(i, h, delta, force);
+        enforceConstraints();
+        if (regionRows > 0)
+            updateSleeping(h);
+        return;
+    }
+
+    startRelaxation();
+    float error = 0.0f;
     for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < m; ++j) {
-            if (particles[i][j].isFixed)
-                continue;
-            glm::vec3 pos = particles[i][j].position;
-            glm::vec3 prevPos = particles[i][j].previousPosition;
-            float mass = particles[i][j].mass;
-            pos = pos + (1.0f - delta) * (pos - prevPos) + ((h*h) / mass) * force;
-            particles[i][j].previousPosition = particles[i][j].position;
-            particles[i][j].position = pos;
-        }
+        integrateRow(i, h, delta, force);
+        if (i >= 2)
+            error += relaxRows(i - 2, i - 1, 1);
     }
+    error += relaxRows(std::max(0, n - 2), n, 1);
+    observeRelaxation(error, 1);
 
-    for (int i = 0; i < n_relaxations; ++i) {
-        for (auto &bar : bars) {
-            bar.update();
+    bool accelerate = chebyshev.enabled();
+    if (accelerate) {
+        chebyshev.startStep(n * m);
+        applyChebyshev();
+    }
+    projectColliders(false);
+
+    // With tiling one iteration is a pass of tileSweeps sweeps per tile.
+    // With multigrid every iteration starts with a V-cycle on the coarse
+    // levels, and the fine sweeps that follow smooth the interpolation.
+    // The colliders are projected after every iteration, so the contacts
+    // converge together with the bars.
+    for (int done = 1; done < n_relaxations; ) {
+        if (coarseSweeps > 0) {
+            saveLevel(levels[0]);
+            vCycle(0);
+            prolongate(0);
+        }
+        if (tileRows > 0) {
+            int sweeps = std::min(tileSweeps, n_relaxations - done);
+            observeRelaxation(relaxTiled(sweeps), sweeps);
+            done += sweeps;
+        } else {
+            observeRelaxation(relaxRows(0, n, 1), 1);
+            ++done;
         }
+        if (accelerate)
+            applyChebyshev();
+        projectColliders(false);
+    }
+    finishRelaxation();
+
+    enforceConstraints();
+    if (regionRows > 0)
+        updateSleeping(h);
+}
+
+// Applies the Chebyshev acceleration to the particles after an iteration.
+void RectangularMesh::applyChebyshev() {
+    double change = 0.0;
+    #pragma omp parallel for reduction(+:change)
+    for (int i = 0; i < n; ++i) {
+        if (!rowAsleep(i))
+            change += chebyshev.accelerate(&particles[i*m], m, i * m);
+    }
+    chebyshev.finishIteration(change);
+}
+
+// Enables sleeping regions of the given number of rows, all of them awake.
+void RectangularMesh::setSleeping(int regionRows, float speed, float error, int steps) {
+    this->regionRows = std::max(regionRows, 0);
+    this->sleepSpeed = speed;
+    this->sleepError = error;
+    this->sleepSteps = std::max(steps, 1);
+    int regions = this->regionRows > 0 ? (n + this->regionRows - 1) / this->regionRows : 0;
+    asleep.assign(regions, false);
+    simulated.assign(regions, true);
+    quietSteps.assign(regions, 0);
+    regionErrors.assign(regions, 0.0f);
+}
+
+// Whether row i belongs to a sleeping region.
+bool RectangularMesh::rowAsleep(int i) {
+    return regionRows > 0 && asleep[i / regionRows];
+}
+
+// Puts the given region to sleep. Its particles stop with zero velocity and
+// get a zero inverse mass, so the bars of the awake regions around it treat
+// them as fixed instead of dragging them along.
+void RectangularMesh::sleepRegion(int r) {
+    asleep[r] = true;
+    int end = std::min(n, (r + 1) * regionRows);
+    for (int k = r * regionRows * m; k < end * m; ++k) {
+        particles[k].previousPosition = particles[k].position;
+        particles[k].inverseMass = 0.0f;
+    }
+}
+
+// Wakes the given region up, restoring the inverse masses of its particles.
+void RectangularMesh::wakeRegion(int r) {
+    if (asleep[r]) {
+        asleep[r] = false;
+        int end = std::min(n, (r + 1) * regionRows);
+        for (int k = r * regionRows * m; k < end * m; ++k)
+            particles[k].setFixed(particles[k].isFixed);
+    }
+    simulated[r] = true;
+    quietSteps[r] = 0;
+}
+
+// Wakes every sleeping region.
+void RectangularMesh::wakeAll() {
+    for (int r = 0; r < static_cast<int>(asleep.size()); ++r)
+        wakeRegion(r);
+}
+
+// Wakes the region of the given particle, for instance after a collision
+// moved it.
+void RectangularMesh::wakeParticle(int k) {
+    if (regionRows > 0)
+        wakeRegion((k / m) / regionRows);
+}
+
+// Whether any particle of the rows [begin, end) may have moved during the
+// last step. The bars of a region reach two rows into the next one, so a
+// sleeping region can still be moved by the region above it.
+bool RectangularMesh::rowsMoved(int begin, int end) {
+    if (regionRows == 0)
+        return true;
+    int last = std::min(end - 1, n - 1) / regionRows;
+    for (int r = std::max(begin - 2, 0) / regionRows; r <= last; ++r) {
+        if (simulated[r])
+            return true;
     }
+    return false;
 }
 
+// Updates the activity of every region after a step. An awake region is
+// quiet when every particle moved less than sleepSpeed * h and the mean
+// error of its bars changed by less than sleepError. The error itself is not
+// used because a cloth at rest keeps its bars stretched by the force; it is
+// the corrections that stop changing. Regions that are not quiet wake their
+// neighbours, and regions that stayed quiet for sleepSteps steps go to sleep.
+// A local disturbance therefore only wakes the regions around it, which go
+// back to sleep once they settle.
+void RectangularMesh::updateSleeping(float h) {
+    int regions = static_cast<int>(asleep.size());
+    float distance = sleepSpeed * h;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int r = 0; r < regions; ++r) {
+        if (asleep[r])
+            continue;
+        int begin = r * regionRows;
+        int end = std::min(n, begin + regionRows);
+        bool quiet = true;
+        for (int k = begin * m; k < end * m && quiet; ++k)
+            quiet = glm::length(particles[k].position - particles[k].previousPosition) < distance;
+
+        float error = 0.0f;
+        for (int b = rowBars[begin]; b < rowBars[end]; ++b) {
+            float length = glm::length(particles[bars[b].index1].position - particles[bars[b].index2].position);
+            error += std::abs(length - bars[b].length);
+        }
+        error /= std::max(rowBars[end] - rowBars[begin], 1);
+        quiet = quiet && std::abs(error - regionErrors[r]) < sleepError;
+        regionErrors[r] = error;
+        quietSteps[r] = quiet ? quietSteps[r] + 1 : 0;
+    }
+
+    // Activity is read before the neighbours are woken, so a wake up only
+    // spreads one region per step.
+    bool previous = false;
+    for (int r = 0; r < regions; ++r) {
+        bool current = !asleep[r] && quietSteps[r] == 0;
+        bool next = r + 1 < regions && !asleep[r + 1] && quietSteps[r + 1] == 0;
+        if (previous || next) {
+            bool woken = asleep[r];
+            wakeRegion(r);
+            simulated[r] = !woken;
+        }
+        previous = current;
+    }
+
+    if (coarseSweeps > 0)
+        return;
+    // Quiet regions sleep in runs bounded by the edges of the mesh or by
+    // sleeping regions, like the islands of a rigid body solver. A region
+    // going to sleep next to an awake one would become fixed for it and
+    // take away the part of the load it was carrying, which is enough of a
+    // jolt to wake everything up again.
+    for (int a = 0; a < regions; ) {
+        if (asleep[a] || quietSteps[a] < sleepSteps) {
+            ++a;
+            continue;
+        }
+        int b = a;
+        while (b < regions && !asleep[b] && quietSteps[b] >= sleepSteps)
+            ++b;
+        if ((a == 0 || asleep[a - 1]) && (b == regions || asleep[b])) {
+            for (int r = a; r < b; ++r)
+                sleepRegion(r);
+        }
+        a = b;
+    }
+}
 
 // Sets the force that acts on the mesh.
 void RectangularMesh::oneStep() {
@@ -1,3 +1,6 @@
+#ifndef RECTANGULARMESH_H
+#define RECTANGULARMESH_H
+
 #include <glm/glm.hpp>
 #include <iostream>
 #include <vector>
@@ -6,22 +9,111 @@
 
 using edge = std::pair<std::pair<int, int>, std::pair<int, int> >;
 
+// Struct that represents a coarse level of the multigrid relaxation. Its
+// nodes are the particles (i, j) with i and j multiples of stride, and its
+// bars join neighbouring nodes, so relaxing them moves the same particles as
+// the fine bars but over distances stride times longer. The bars only keep
+// the nodes from getting farther apart than in the flat cloth.
+struct GridLevel {
+    int stride;
+    int rows, columns;
+    std::vector<Bar> bars;
+
+    // Positions of the nodes before the coarser levels were relaxed and the
+    // correction they received, indexed by node (i/stride)*columns + j/stride.
+    std::vector<glm::vec3> saved;
+    std::vector<glm::vec3> corrections;
+};
+
 // Class that represents a rectangular mesh. Contains a set of edges
 // which serve to avoid creating duplicate bars.
 class RectangularMesh : public Mesh {
     std::set<edge> edges;
 
+    // The bars are stored sorted by the first row they touch. rowBars[i] is
+    // the index of the first bar of row i and rowBars[n] the number of bars.
+    std::vector<int> rowBars;
+
     // Checks whether given indexes are in expected proportions.
     bool inBounds(int n, int m, int i, int j);
 
     // Receives two pairs of coordinates ( (n, m) and (i, j) ) and checks
     // whether an edge with those already exists.
     // Edges are used to avoid creating two identical bars.
-    void createBarIfNotExist(int n, int m, int i, int j, int k, int l);
+    void createBarIfNotExist(int n, int m, int i, int j, int k, int l, std::vector<int> &barRows);
+
+    // Relaxes the bars owned by rows [begin, end) the given number of times.
+    // Returns the bar error found by the last sweep.
+    float relaxRows(int begin, int end, int sweeps);
+
+    // Runs the given number of sweeps tile by tile, see setTiling.
+    float relaxTiled(int sweeps);
+
+    // Moves the particles of row i to their predicted position.
+    void integrateRow(int i, float h, float delta, glm::vec3 force);
+
+    // Applies the Chebyshev acceleration to the particles after an iteration.
+    void applyChebyshev();
+
+    // Coarse levels of the multigrid relaxation, from finer to coarser.
+    std::vector<GridLevel> levels;
+
+    // Relaxes the bars of the given coarse level the given number of times.
+    void relaxLevel(GridLevel &grid, int sweeps);
+
+    // Stores the positions of the nodes of the given coarse level.
+    void saveLevel(GridLevel &grid);
+
+    // Runs a V-cycle from the given coarse level down to the coarsest one.
+    void vCycle(int level);
+
+    // Interpolates the corrections of the given coarse level to the nodes
+    // of the next finer level, or to every particle for the first level.
+    void prolongate(int level);
+
+    // Whether each region is asleep, was simulated during the last step, for
+    // how many consecutive steps it has been quiet and its mean bar error
+    // after the last step.
+    std::vector<bool> asleep;
+    std::vector<bool> simulated;
+    std::vector<int> quietSteps;
+    std::vector<float> regionErrors;
+
+    // Whether row i belongs to a sleeping region.
+    bool rowAsleep(int i);
+
+    // Puts the given region to sleep or wakes it up.
+    void sleepRegion(int r);
+    void wakeRegion(int r);
+
+    // Updates the activity of every region after a step, putting quiet
+    // regions to sleep and waking the neighbours of active ones.
+    void updateSleeping(float h);
 
 public:
+    // The particles are stored row by row, particle (i, j) is particles[i*m + j].
     int n, m;
-    std::vector<std::vector<Particle> > particles;
+
+    // Number of rows in each tile of the tiled relaxation and number of sweeps
+    // a tile does before moving on. Tiling is disabled when tileRows is 0.
+    int tileRows;
+    int tileSweeps;
+
+    // Rest distance between neighbouring particles.
+    float barLength;
+
+    // Number of sweeps on each coarse level before and after the coarser
+    // ones in a V-cycle. The multigrid relaxation is disabled when it is 0.
+    int coarseSweeps;
+
+    // Number of rows of each sleeping region, and the speed, change of the
+    // mean bar error and number of quiet steps below which a region goes to
+    // sleep. Sleeping is
+    // disabled when regionRows is 0.
+    int regionRows;
+    float sleepSpeed;
+    float sleepError;
+    int sleepSteps;
 
     // Rectangular mesh constructor. Creates a nxm mesh, receiving the mass to create the particles, the number
     // of relaxations that each bar does per step, the step size, the damping coefficient,
@@ -35,6 +127,41 @@ public:
                     glm::vec3 force,
                     glm::vec3 initialVelocity);
 
+    // Enables the tiled relaxation. The mesh is split in bands of rows small
+    // enough for their particles and bars to fit in cacheBytes, and each band
+    // relaxes tileSweeps times while it is in cache. Corrections only cross
+    // band boundaries between passes, so larger bands and fewer sweeps per
+    // pass stay closer to the untiled result. A tileSweeps of 0 disables tiling.
+    void setTiling(int tileSweeps, int cacheBytes = 1 << 20);
+
+    // Enables the multigrid relaxation with up to the given number of coarse
+    // levels, each one half the resolution of the previous one. Every
+    // relaxation iteration after the first one becomes a V-cycle: the
+    // coarse levels are relaxed, their corrections are interpolated back to
+    // the finer levels and the fine bars are swept once. A levels of 0
+    // disables it.
+    void setMultigrid(int levels, int coarseSweeps = 2);
+
+    // Enables sleeping regions of the given number of rows. A region whose
+    // particles move slower than speed and whose mean bar error changes by
+    // less than error for the given number of steps goes to sleep: it is skipped by
+    // the integration and the relaxation until a neighbouring region moves,
+    // the force changes or wakeParticle is called for one of its particles.
+    // Only the position based relaxation uses it, and regions never sleep
+    // while the multigrid relaxation is enabled. A regionRows of 0 disables it.
+    void setSleeping(int regionRows, float speed = 1e-3f, float error = 1e-3f, int steps = 30);
+
+    // Wakes every sleeping region.
+    void wakeAll();
+
+    // Wakes the region of the given particle, for instance after a collision
+    // moved it.
+    void wakeParticle(int k);
+
+    // Whether any particle of the rows [begin, end) may have moved during
+    // the last step.
+    bool rowsMoved(int begin, int end);
+
     // Implementation of oneStep without receiving paramenters.s
     void oneStep();
 
@@ -42,3 +169,5 @@ public:
     // and calculates the next position of each particle.
     void oneStep(float h, float delta, glm::vec3 force);
 };
+
+#endif // RECTANGULARMESH_H
@@ -0,0 +1,329 @@
+#include "scene.h"
+#include <algorithm>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// Number of consecutive particles in a patch.
+const int PATCH = 32;
+
+// Whether the boxes [lowA, highA] and [lowB, highB] overlap.
+bool overlap(glm::vec3 lowA, glm::vec3 highA, glm::vec3 lowB, glm::vec3 highB) {
+    return !glm::any(glm::lessThan(highA, lowB)) && !glm::any(glm::lessThan(highB, lowA));
+}
+
+// Sorts order by the given key. An order of the wrong size is rebuilt and
+// sorted from scratch, like one whose key changed; otherwise it is assumed
+// to be almost sorted already and an insertion sort moves every element
+// back only as far as it went past its neighbours.
+template <class Key>
+void sortOrder(std::vector<int> &order, int size, bool rebuild, Key key) {
+    if (rebuild || static_cast<int>(order.size()) != size) {
+        order.resize(size);
+        for (int i = 0; i < size; ++i)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return key(a) < key(b); });
+        return;
+    }
+    for (int i = 1; i < size; ++i) {
+        int current = order[i];
+        float value = key(current);
+        int j = i;
+        for (; j > 0 && key(order[j - 1]) > value; --j)
+            order[j] = order[j - 1];
+        order[j] = current;
+    }
+}
+
+}
+
+// Constructor responsible for creating an empty scene without contacts.
+Scene::Scene() : axis(-1), thickness(0.0f), friction(0.0f), iterations(1) { }
+
+// Whether the contacts between the meshes should be handled.
+bool Scene::enabled() {
+    return thickness > 0.0f && iterations > 0 && meshes.size() > 1;
+}
+
+// Enables the contacts between the meshes.
+void Scene::setContacts(float thickness, float friction, int iterations) {
+    this->thickness = std::max(thickness, 0.0f);
+    this->friction = std::min(std::max(friction, 0.0f), 1.0f);
+    this->iterations = std::max(iterations, 1);
+}
+
+// Splits every mesh in runs of PATCH consecutive particles again when its
+// number of particles changed, for instance after an adaptive mesh adapted.
+bool Scene::buildPatches() {
+    int count = static_cast<int>(meshes.size());
+    bool changed = static_cast<int>(patchedParticles.size()) != count;
+    for (int i = 0; i < count && !changed; ++i)
+        changed = patchedParticles[i] != static_cast<int>(meshes[i]->particles.size());
+    if (!changed)
+        return false;
+
+    patches.clear();
+    meshPatches.assign(1, 0);
+    patchedParticles.resize(count);
+    corrections.resize(count);
+    for (int i = 0; i < count; ++i) {
+        int size = static_cast<int>(meshes[i]->particles.size());
+        patchedParticles[i] = size;
+        corrections[i].resize(size);
+        for (int begin = 0; begin < size; begin += PATCH) {
+            Patch patch = {i, begin, std::min(begin + PATCH, size), glm::vec3(0.0f), glm::vec3(0.0f)};
+            patches.push_back(patch);
+        }
+        meshPatches.push_back(static_cast<int>(patches.size()));
+    }
+    patchContacts.resize(patches.size());
+    return true;
+}
+
+// Computes the boxes of the patches in parallel, grown by half the
+// thickness, and the box of every mesh from those of its patches. The
+// inactive particles are left out, so a patch without active particles gets
+// an empty box that overlaps nothing.
+void Scene::updateBounds() {
+    int size = static_cast<int>(patches.size());
+    glm::vec3 margin(0.5f * thickness);
+
+    #pragma omp parallel for
+    for (int a = 0; a < size; ++a) {
+        Patch &patch = patches[a];
+        std::vector<Particle> &particles = meshes[patch.mesh]->particles;
+        glm::vec3 low(INFINITY), high(-INFINITY);
+        for (int k = patch.begin; k < patch.end; ++k) {
+            if (!particles[k].isActive)
+                continue;
+            low = glm::min(low, particles[k].position);
+            high = glm::max(high, particles[k].position);
+        }
+        patch.low = low - margin;
+        patch.high = high + margin;
+    }
+
+    int count = static_cast<int>(meshes.size());
+    meshLow.assign(count, glm::vec3(INFINITY));
+    meshHigh.assign(count, glm::vec3(-INFINITY));
+    for (int i = 0; i < count; ++i) {
+        for (int a = meshPatches[i]; a < meshPatches[i + 1]; ++a) {
+            meshLow[i] = glm::min(meshLow[i], patches[a].low);
+            meshHigh[i] = glm::max(meshHigh[i], patches[a].high);
+        }
+    }
+}
+
+// Chooses the axis along which the centers of the patches vary the most,
+// leaving out the empty ones, and sorts the meshes and the patches by the
+// lower bound of their boxes on it.
+void Scene::sortBoxes() {
+    int size = static_cast<int>(patches.size());
+    int filled = 0;
+    glm::vec3 sum(0.0f), squares(0.0f);
+    for (auto &patch : patches) {
+        if (patch.low.x > patch.high.x)
+            continue;
+        glm::vec3 center = 0.5f * (patch.low + patch.high);
+        sum += center;
+        squares += center * center;
+        ++filled;
+    }
+    glm::vec3 variance = squares - sum * sum / static_cast<float>(std::max(filled, 1));
+    int best = variance.x >= variance.y ? (variance.x >= variance.z ? 0 : 2) : (variance.y >= variance.z ? 1 : 2);
+    bool rebuild = best != axis;
+    axis = best;
+
+    sortOrder(meshOrder, static_cast<int>(meshes.size()), rebuild, [&](int i) { return meshLow[i][axis]; });
+    sortOrder(patchOrder, size, rebuild, [&](int a) { return patches[a].low[axis]; });
+}
+
+// Finds the overlapping pairs of meshes and then the overlapping pairs of
+// patches of different meshes that may touch, sweeping each sorted list
+// once. The pairs are then turned into the neighbours of every patch with a
+// counting sort, like the triangles around each particle.
+void Scene::findPairs() {
+    int count = static_cast<int>(meshes.size());
+    meshPairs.assign(count * count, 0);
+    std::vector<char> touching(count, 0);
+    for (int a = 0; a < count; ++a) {
+        int i = meshOrder[a];
+        for (int b = a + 1; b < count; ++b) {
+            int j = meshOrder[b];
+            if (meshLow[j][axis] > meshHigh[i][axis])
+                break;
+            if (overlap(meshLow[i], meshHigh[i], meshLow[j], meshHigh[j])) {
+                meshPairs[i * count + j] = meshPairs[j * count + i] = 1;
+                touching[i] = touching[j] = 1;
+            }
+        }
+    }
+
+    int size = static_cast<int>(patches.size());
+    pairs.clear();
+    for (int a = 0; a < size; ++a) {
+        const Patch &p = patches[patchOrder[a]];
+        if (!touching[p.mesh])
+            continue;
+        for (int b = a + 1; b < size; ++b) {
+            const Patch &q = patches[patchOrder[b]];
+            if (q.low[axis] > p.high[axis])
+                break;
+            if (q.mesh != p.mesh && meshPairs[p.mesh * count + q.mesh] && overlap(p.low, p.high, q.low, q.high))
+                pairs.push_back(glm::ivec2(patchOrder[a], patchOrder[b]));
+        }
+    }
+
+    neighbourStart.assign(size + 1, 0);
+    for (auto &pair : pairs) {
+        neighbourStart[pair.x + 1]++;
+        neighbourStart[pair.y + 1]++;
+    }
+    for (int a = 0; a < size; ++a)
+        neighbourStart[a + 1] += neighbourStart[a];
+    neighbours.resize(neighbourStart[size]);
+    std::vector<int> next(neighbourStart.begin(), neighbourStart.end() - 1);
+    for (auto &pair : pairs) {
+        neighbours[next[pair.x]++] = pair.y;
+        neighbours[next[pair.y]++] = pair.x;
+    }
+}
+
+// Advances every mesh one step and then pushes apart the particles of
+// different meshes closer than thickness. The meshes are stepped by
+// different threads, largest first, when there are enough of them to keep
+// every thread busy; otherwise they are stepped one after the other, each
+// one using every thread. Each contact iteration is a Jacobi pass like the
+// self collisions: every particle of a patch with neighbours sums its own
+// share of the correction of its contacts with their particles, skipping
+// the neighbours whose box it is not close to, and only writes to itself.
+// The regions of the meshes touched by a contact are woken up at the end.
+// A sleeping particle does not move and finds no contacts of its own, so
+// the sleeping particles hit by others are recorded and woken as well. The
+// meshes with contacts are then projected out of their colliders again, so
+// the colliders keep the last word. Their friction is not applied twice,
+// since the step of the mesh already did.
+int Scene::step() {
+    int count = static_cast<int>(meshes.size());
+    stepOrder.resize(count);
+    for (int i = 0; i < count; ++i)
+        stepOrder[i] = i;
+    std::stable_sort(stepOrder.begin(), stepOrder.end(), [&](int a, int b) {
+        return meshes[a]->particles.size() > meshes[b]->particles.size();
+    });
+
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    #pragma omp parallel for schedule(dynamic, 1) if(count >= threads)
+    for (int i = 0; i < count; ++i)
+        meshes[stepOrder[i]]->oneStep();
+
+    if (!enabled())
+        return 0;
+
+    buildPatches();
+    updateBounds();
+    sortBoxes();
+    findPairs();
+
+    int size = static_cast<int>(patches.size());
+    float thickness2 = thickness * thickness;
+    glm::vec3 margin(0.5f * thickness);
+    std::fill(patchContacts.begin(), patchContacts.end(), 0);
+    sleeping.clear();
+    int contacts = 0;
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        contacts = 0;
+        #pragma omp parallel
+        {
+        std::vector<glm::ivec2> touched;
+
+        #pragma omp for reduction(+:contacts) schedule(dynamic, 16)
+        for (int a = 0; a < size; ++a) {
+            if (neighbourStart[a] == neighbourStart[a + 1])
+                continue;
+            const Patch &patch = patches[a];
+            std::vector<Particle> &particles = meshes[patch.mesh]->particles;
+            std::vector<glm::vec3> &own = corrections[patch.mesh];
+            int found = 0;
+            for (int k = patch.begin; k < patch.end; ++k) {
+                const Particle &p = particles[k];
+                glm::vec3 correction(0.0f);
+                if (p.inverseMass == 0.0f) {
+                    own[k] = correction;
+                    continue;
+                }
+
+                glm::vec3 motion = p.position - p.previousPosition;
+                for (int e = neighbourStart[a]; e < neighbourStart[a + 1]; ++e) {
+                    const Patch &other = patches[neighbours[e]];
+                    if (!overlap(p.position, p.position, other.low - margin, other.high + margin))
+                        continue;
+                    std::vector<Particle> &others = meshes[other.mesh]->particles;
+                    for (int j = other.begin; j < other.end; ++j) {
+                        const Particle &q = others[j];
+                        if (!q.isActive)
+                            continue;
+                        glm::vec3 d = p.position - q.position;
+                        float distance2 = glm::dot(d, d);
+                        if (distance2 >= thickness2 || distance2 == 0.0f)
+                            continue;
+                        if (q.inverseMass == 0.0f && !q.isFixed)
+                            touched.push_back(glm::ivec2(other.mesh, j));
+
+                        float distance = std::sqrt(distance2);
+                        glm::vec3 n = d / distance;
+                        float share = p.inverseMass / (p.inverseMass + q.inverseMass);
+                        correction += (share * (thickness - distance)) * n;
+
+                        glm::vec3 relative = motion - (q.position - q.previousPosition);
+                        glm::vec3 tangential = relative - glm::dot(relative, n) * n;
+                        correction -= (share * friction) * tangential;
+                        ++found;
+                    }
+                }
+                own[k] = correction;
+            }
+            patchContacts[a] += found;
+            contacts += found;
+        }
+
+        #pragma omp critical
+        sleeping.insert(sleeping.end(), touched.begin(), touched.end());
+        }
+
+        #pragma omp parallel for
+        for (int a = 0; a < size; ++a) {
+            if (neighbourStart[a] == neighbourStart[a + 1])
+                continue;
+            const Patch &patch = patches[a];
+            std::vector<Particle> &particles = meshes[patch.mesh]->particles;
+            for (int k = patch.begin; k < patch.end; ++k)
+                particles[k].position += corrections[patch.mesh][k];
+        }
+    }
+
+    std::vector<char> touched(count, 0);
+    for (int a = 0; a < size; ++a) {
+        if (patchContacts[a] == 0)
+            continue;
+        touched[patches[a].mesh] = 1;
+        meshes[patches[a].mesh]->wakeParticle(patches[a].begin);
+        meshes[patches[a].mesh]->wakeParticle(patches[a].end - 1);
+    }
+    for (auto &particle : sleeping)
+        meshes[particle.x]->wakeParticle(particle.y);
+
+    #pragma omp parallel for schedule(dynamic, 1) if(count >= threads)
+    for (int i = 0; i < count; ++i) {
+        Mesh &mesh = *meshes[i];
+        if (touched[i] && mesh.colliders.enabled())
+            mesh.colliders.project(mesh.particles, false);
+    }
+    return contacts / 2;
+}
@@ -0,0 +1,126 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "mesh.h"
+
+// Struct that represents a patch of a mesh in the broadphase: the particles
+// [begin, end) of the mesh and their bounding box, grown by half the contact
+// thickness on every side so two patches with particles in contact overlap.
+struct Patch {
+    int mesh;
+    int begin, end;
+    glm::vec3 low, high;
+};
+
+// Class that represents a set of meshes of any kind simulated together. The
+// meshes are stepped in parallel, each one with its own step, damping and
+// force, and then the particles of different meshes are kept at least
+// thickness apart, the same way the self collisions of a mesh are.
+//
+// The contacts are found with a sweep and prune broadphase in two levels:
+// the bounding boxes of the meshes give the pairs of meshes that may touch,
+// and the bounding boxes of their patches, runs of consecutive particles
+// which are close to each other in a cloth, give the pairs of patches whose
+// particles are compared. At each level the boxes are kept sorted by their
+// lower bound along one axis, and a box is only compared with the ones that
+// follow it until their lower bound passes its upper bound. The boxes move
+// little between steps, so the order of the last step is almost sorted and
+// an insertion sort brings it up to date in close to linear time. The axis
+// is the one along which the patches are most spread, so the patches of a
+// flat cloth do not all overlap on it; the boxes are sorted from scratch
+// when it changes.
+class Scene {
+    // Patches of every mesh, those of mesh i being patches[meshPatches[i]]
+    // to patches[meshPatches[i + 1] - 1], and the number of particles of
+    // each mesh they were built for.
+    std::vector<Patch> patches;
+    std::vector<int> meshPatches;
+    std::vector<int> patchedParticles;
+
+    // Bounding box of every mesh, union of those of its patches.
+    std::vector<glm::vec3> meshLow, meshHigh;
+
+    // Meshes and patches sorted by the lower bound of their box along axis.
+    std::vector<int> meshOrder;
+    std::vector<int> patchOrder;
+    int axis;
+
+    // Whether each pair of meshes (i, j) may touch, at i*count + j.
+    std::vector<char> meshPairs;
+
+    // Patches of other meshes whose boxes overlap each patch, those of
+    // patch p being neighbours[neighbourStart[p]] to
+    // neighbours[neighbourStart[p + 1] - 1].
+    std::vector<glm::ivec2> pairs;
+    std::vector<int> neighbourStart;
+    std::vector<int> neighbours;
+
+    // Correction of each particle of each mesh in the current iteration,
+    // number of contacts of each patch during the step and sleeping
+    // particles, as (mesh, particle), hit by an awake one during the step.
+    std::vector<std::vector<glm::vec3>> corrections;
+    std::vector<int> patchContacts;
+    std::vector<glm::ivec2> sleeping;
+
+    // Meshes sorted by decreasing number of particles, the order in which
+    // they are handed to the threads.
+    std::vector<int> stepOrder;
+
+    // Splits every mesh in patches again when its number of particles
+    // changed. Returns whether anything changed.
+    bool buildPatches();
+
+    // Computes the boxes of the patches and of the meshes.
+    void updateBounds();
+
+    // Chooses the axis of the sweep and sorts the meshes and the patches
+    // along it.
+    void sortBoxes();
+
+    // Finds the pairs of meshes and then the pairs of patches whose boxes
+    // overlap.
+    void findPairs();
+
+public:
+    // The meshes of the scene.
+    std::vector<std::unique_ptr<Mesh>> meshes;
+
+    // Minimum distance between particles of different meshes, fraction of
+    // the tangential relative motion removed at each contact and number of
+    // iterations per step. The contacts are disabled when the thickness is 0.
+    float thickness;
+    float friction;
+    int iterations;
+
+    // Constructor responsible for creating an empty scene without contacts.
+    Scene();
+
+    // Whether the contacts between the meshes should be handled.
+    bool enabled();
+
+    // Creates a mesh of type T in the scene with the given constructor
+    // arguments and returns it. The meshes are built in place, since their
+    // bars point to their own particles and a copy would point to the old
+    // ones.
+    template <class T, class... Args>
+    T &add(Args &&... args) {
+        T *mesh = new T(std::forward<Args>(args)...);
+        meshes.push_back(std::unique_ptr<Mesh>(mesh));
+        return *mesh;
+    }
+
+    // Enables the contacts between the meshes, keeping their particles
+    // thickness apart, with the given friction and iterations per step.
+    // A thickness of 0 disables them.
+    void setContacts(float thickness, float friction = 0.0f, int iterations = 1);
+
+    // Advances every mesh one step and then resolves the contacts between
+    // them. Returns the number of contacts found in the last iteration.
+    int step();
+};
+
+#endif // SCENE_H
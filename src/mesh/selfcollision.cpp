@@ -0,0 +1,230 @@
+#include "selfcollision.h"
+#include <algorithm>
+#include <cmath>
+
+
+// Constructor responsible for creating a disabled solver.
+SelfCollision::SelfCollision()
+    : analyzedBars(0), rebuild(true), tableSize(0), thickness(0.0f), friction(0.0f), iterations(1) { }
+
+// Whether the collisions should be handled.
+bool SelfCollision::enabled() {
+    return thickness > 0.0f && iterations > 0;
+}
+
+// Makes the next solve build the bar neighbours again. Comparing every bar
+// each step would cost more than the collisions themselves on a large
+// cloth, so only the number of bars is checked automatically.
+void SelfCollision::invalidate() {
+    rebuild = true;
+}
+
+// Builds the sorted bar neighbours of each particle with a counting sort of
+// the bar endpoints.
+void SelfCollision::buildExclusions(int size, std::vector<Bar> &bars) {
+    int count = static_cast<int>(bars.size());
+    analyzedBars = count;
+    rebuild = false;
+    excludedStart.assign(size + 1, 0);
+    for (auto &bar : bars) {
+        excludedStart[bar.index1 + 1]++;
+        excludedStart[bar.index2 + 1]++;
+    }
+    for (int k = 0; k < size; ++k)
+        excludedStart[k + 1] += excludedStart[k];
+
+    excluded.resize(2 * count);
+    std::vector<int> next(excludedStart.begin(), excludedStart.end() - 1);
+    for (auto &bar : bars) {
+        excluded[next[bar.index1]++] = bar.index2;
+        excluded[next[bar.index2]++] = bar.index1;
+    }
+
+    #pragma omp parallel for
+    for (int k = 0; k < size; ++k)
+        std::sort(excluded.begin() + excludedStart[k], excluded.begin() + excludedStart[k + 1]);
+}
+
+// Bucket of the given cell: the usual XOR of the coordinates times large
+// primes (Teschner et al. 2003), masked to the power of two table size.
+int SelfCollision::bucket(glm::ivec3 cell) {
+    unsigned int h = (static_cast<unsigned int>(cell.x) * 73856093u)
+                   ^ (static_cast<unsigned int>(cell.y) * 19349663u)
+                   ^ (static_cast<unsigned int>(cell.z) * 83492791u);
+    return static_cast<int>(h & static_cast<unsigned int>(tableSize - 1));
+}
+
+// Whether the particles a and b are joined by a bar.
+bool SelfCollision::isExcluded(int a, int b) {
+    return std::binary_search(excluded.begin() + excludedStart[a], excluded.begin() + excludedStart[a + 1], b);
+}
+
+// Bins the particles in the spatial hash. The particles are sorted by
+// bucket with a least significant digit radix sort, each pass a parallel
+// counting sort: the particles are split in fixed chunks, every chunk counts
+// its digits, the counts are turned into offsets digit by digit and chunk by
+// chunk, and every chunk scatters its particles in order. The sort is stable
+// and the chunks do not depend on the threads, so the particles of a bucket
+// always end up sorted by index, and no atomic operation is needed.
+void SelfCollision::buildGrid(std::vector<Particle> &particles) {
+    const int chunks = 64;
+    const int radixBits = 11;
+    const int radix = 1 << radixBits;
+    int size = static_cast<int>(particles.size());
+    int bits = 0;
+    tableSize = 1;
+    while (tableSize < 2 * size) {
+        tableSize *= 2;
+        ++bits;
+    }
+
+    cells.resize(size);
+    buckets.resize(size);
+    sorted.resize(size);
+    scratchBuckets.resize(size);
+    scratchSorted.resize(size);
+    counts.resize(chunks * radix);
+    float inverseCell = 0.5f / thickness;
+
+    #pragma omp parallel for
+    for (int k = 0; k < size; ++k) {
+        cells[k] = glm::ivec3(glm::floor(particles[k].position * inverseCell));
+        buckets[k] = bucket(cells[k]);
+        sorted[k] = k;
+    }
+
+    int chunkSize = (size + chunks - 1) / chunks;
+    for (int shift = 0; shift < bits; shift += radixBits) {
+        #pragma omp parallel for
+        for (int c = 0; c < chunks; ++c) {
+            int *count = &counts[c * radix];
+            std::fill(count, count + radix, 0);
+            int end = std::min((c + 1) * chunkSize, size);
+            for (int i = c * chunkSize; i < end; ++i)
+                count[(buckets[i] >> shift) & (radix - 1)]++;
+        }
+
+        int offset = 0;
+        for (int d = 0; d < radix; ++d) {
+            for (int c = 0; c < chunks; ++c) {
+                int count = counts[c * radix + d];
+                counts[c * radix + d] = offset;
+                offset += count;
+            }
+        }
+
+        #pragma omp parallel for
+        for (int c = 0; c < chunks; ++c) {
+            int *next = &counts[c * radix];
+            int end = std::min((c + 1) * chunkSize, size);
+            for (int i = c * chunkSize; i < end; ++i) {
+                int slot = next[(buckets[i] >> shift) & (radix - 1)]++;
+                scratchBuckets[slot] = buckets[i];
+                scratchSorted[slot] = sorted[i];
+            }
+        }
+        buckets.swap(scratchBuckets);
+        sorted.swap(scratchSorted);
+    }
+
+    // buckets is now sorted too, so every bucket starts where the sorted
+    // buckets step over it.
+    bucketStart.resize(tableSize + 1);
+    #pragma omp parallel for
+    for (int i = 0; i <= size; ++i) {
+        int first = i == 0 ? 0 : buckets[i - 1] + 1;
+        int last = i == size ? tableSize : buckets[i];
+        for (int b = first; b <= last; ++b)
+            bucketStart[b] = i;
+    }
+}
+
+// Pushes apart the particles closer than thickness. The grid is built again
+// at the start of every iteration, since the previous ones moved the
+// particles, with cells twice as wide as the thickness, so the ball of radius
+// thickness around a particle only overlaps the 2x2x2 cells around the
+// corner of its cell it is closest to. Several of those cells may share a
+// bucket, so only the particles whose cell is the one being visited are
+// considered, which also skips the particles of unrelated cells that share
+// the bucket. Each iteration is a Jacobi pass:
+// every particle sums its own share of the correction of each of its
+// contacts, weighted by the inverse masses, and only writes to itself, and
+// the corrections are applied at the end. The friction removes part of the
+// tangential relative motion of the step at each contact. A sleeping
+// particle, with no inverse mass but not fixed, acts as a fixed one, and is
+// recorded so the mesh can wake it up.
+int SelfCollision::solve(std::vector<Particle> &particles, std::vector<Bar> &bars) {
+    int size = static_cast<int>(particles.size());
+    if (rebuild || static_cast<int>(excludedStart.size()) != size + 1 || analyzedBars != static_cast<int>(bars.size()))
+        buildExclusions(size, bars);
+    corrections.resize(size);
+
+    float thickness2 = thickness * thickness;
+    float inverseCell = 0.5f / thickness;
+    int contacts = 0;
+    sleeping.clear();
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        buildGrid(particles);
+        contacts = 0;
+        #pragma omp parallel
+        {
+        std::vector<int> touched;
+
+        #pragma omp for reduction(+:contacts)
+        for (int k = 0; k < size; ++k) {
+            const Particle &p = particles[k];
+            glm::vec3 correction(0.0f);
+            if (p.inverseMass == 0.0f) {
+                corrections[k] = correction;
+                continue;
+            }
+
+            // The cells of the block go from the cell of the particle towards
+            // the nearest corner.
+            glm::vec3 local = particles[k].position * inverseCell - glm::vec3(cells[k]);
+            glm::ivec3 low = cells[k] - glm::ivec3(glm::lessThan(local, glm::vec3(0.5f)));
+
+            glm::vec3 motion = p.position - p.previousPosition;
+            for (int c = 0; c < 8; ++c) {
+                glm::ivec3 cell = low + glm::ivec3(c & 1, (c >> 1) & 1, c >> 2);
+                int b = bucket(cell);
+                for (int e = bucketStart[b]; e < bucketStart[b + 1]; ++e) {
+                    int j = sorted[e];
+                    if (j == k || cells[j] != cell)
+                        continue;
+                    const Particle &q = particles[j];
+                    if (!q.isActive)
+                        continue;
+                    glm::vec3 d = p.position - q.position;
+                    float distance2 = glm::dot(d, d);
+                    if (distance2 >= thickness2 || distance2 == 0.0f || isExcluded(k, j))
+                        continue;
+                    if (q.inverseMass == 0.0f && !q.isFixed)
+                        touched.push_back(j);
+
+                    float distance = std::sqrt(distance2);
+                    glm::vec3 n = d / distance;
+                    float share = p.inverseMass / (p.inverseMass + q.inverseMass);
+                    correction += (share * (thickness - distance)) * n;
+
+                    glm::vec3 relative = motion - (q.position - q.previousPosition);
+                    glm::vec3 tangential = relative - glm::dot(relative, n) * n;
+                    correction -= (share * friction) * tangential;
+                    ++contacts;
+                }
+            }
+            corrections[k] = correction;
+        }
+
+        #pragma omp critical
+        sleeping.insert(sleeping.end(), touched.begin(), touched.end());
+        }
+
+        #pragma omp parallel for
+        for (int k = 0; k < size; ++k)
+            particles[k].position += corrections[k];
+    }
+    std::sort(sleeping.begin(), sleeping.end());
+    sleeping.erase(std::unique(sleeping.begin(), sleeping.end()), sleeping.end());
+    return contacts / 2;
+}
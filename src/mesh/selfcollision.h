@@ -0,0 +1,88 @@
+#ifndef SELFCOLLISION_H
+#define SELFCOLLISION_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "particle.h"
+#include "bar.h"
+
+// Class responsible for keeping the particles of a mesh at least thickness
+// apart from each other, so the cloth does not pass through itself. The
+// particles are binned every iteration in a uniform grid of cells twice the
+// thickness wide, stored as a spatial hash: the cells are hashed into a
+// table twice as large as the number of particles and the particles are
+// sorted by bucket with a parallel counting sort. Every particle then looks
+// for close particles in the 8 cells around the nearest corner of its cell
+// and pushes itself away from them. Particles
+// joined by a bar are never in contact, so they are skipped through a sorted
+// list of the bar neighbours of each particle built once per topology.
+class SelfCollision {
+    // Bar neighbours of each particle, sorted, those of particle k being
+    // excluded[excludedStart[k]] to excluded[excludedStart[k + 1] - 1].
+    std::vector<int> excludedStart;
+    std::vector<int> excluded;
+
+    // Number of bars the exclusions were built from and whether they must
+    // be built again.
+    int analyzedBars;
+    bool rebuild;
+
+    // Spatial hash: cell of each particle, the particles sorted by bucket,
+    // and by index inside each bucket so the result does not depend on the
+    // threads, with their buckets, and first entry of each bucket in sorted.
+    std::vector<glm::ivec3> cells;
+    std::vector<int> sorted;
+    std::vector<int> buckets;
+    std::vector<int> bucketStart;
+    int tableSize;
+
+    // Buffers of the radix sort: the other half of each ping-pong pair and
+    // the digit counts of each chunk.
+    std::vector<int> scratchSorted;
+    std::vector<int> scratchBuckets;
+    std::vector<int> counts;
+
+    // Correction of each particle in the current iteration.
+    std::vector<glm::vec3> corrections;
+
+    // Builds the bar neighbours of each particle.
+    void buildExclusions(int size, std::vector<Bar> &bars);
+
+    // Bins the particles in the spatial hash.
+    void buildGrid(std::vector<Particle> &particles);
+
+    // Bucket of the given cell.
+    int bucket(glm::ivec3 cell);
+
+    // Whether the particles a and b are joined by a bar.
+    bool isExcluded(int a, int b);
+
+public:
+    // Minimum distance between two particles, fraction of the tangential
+    // relative motion removed at each contact and number of iterations per
+    // step. The collisions are disabled when the thickness is 0.
+    float thickness;
+    float friction;
+    int iterations;
+
+    // Sleeping particles, with no inverse mass but not fixed, that an awake
+    // particle touched during the last solve, sorted.
+    std::vector<int> sleeping;
+
+    // Constructor responsible for creating a disabled solver.
+    SelfCollision();
+
+    // Whether the collisions should be handled.
+    bool enabled();
+
+    // Makes the next solve build the bar neighbours again. Must be called
+    // when the bars change without changing their number.
+    void invalidate();
+
+    // Pushes apart the particles closer than thickness, weighted by their
+    // inverse masses. Returns the number of contacts found in the last
+    // iteration.
+    int solve(std::vector<Particle> &particles, std::vector<Bar> &bars);
+};
+
+#endif // SELFCOLLISION_H
@@ -0,0 +1,199 @@
+#include "sparsecholesky.h"
+#include <algorithm>
+#include <cmath>
+
+// Constructor responsible for creating an empty factorization.
+SparseCholesky::SparseCholesky() : n(0) { }
+
+// Computes the reverse Cuthill-McKee ordering of the pattern. Each connected
+// component is walked breadth first from a vertex of minimum degree, visiting
+// neighbours by increasing degree, and the result is reversed. This keeps the
+// nonzeros close to the diagonal, which bounds the fill of L.
+void SparseCholesky::order(const std::vector<int> &rowStart, const std::vector<int> &columns) {
+    std::vector<int> degree(n);
+    for (int i = 0; i < n; ++i)
+        degree[i] = rowStart[i + 1] - rowStart[i];
+
+    std::vector<int> vertices(n);
+    for (int i = 0; i < n; ++i)
+        vertices[i] = i;
+    std::stable_sort(vertices.begin(), vertices.end(),
+                     [&degree](int a, int b) { return degree[a] < degree[b]; });
+
+    std::vector<bool> visited(n, false);
+    std::vector<int> neighbours;
+    permutation.clear();
+    for (int root : vertices) {
+        if (visited[root])
+            continue;
+        visited[root] = true;
+        int head = static_cast<int>(permutation.size());
+        permutation.push_back(root);
+        while (head < static_cast<int>(permutation.size())) {
+            int u = permutation[head++];
+            neighbours.clear();
+            for (int p = rowStart[u]; p < rowStart[u + 1]; ++p) {
+                int v = columns[p];
+                if (!visited[v]) {
+                    visited[v] = true;
+                    neighbours.push_back(v);
+                }
+            }
+            std::stable_sort(neighbours.begin(), neighbours.end(),
+                             [&degree](int a, int b) { return degree[a] < degree[b]; });
+            permutation.insert(permutation.end(), neighbours.begin(), neighbours.end());
+        }
+    }
+    std::reverse(permutation.begin(), permutation.end());
+
+    inverse.resize(n);
+    for (int k = 0; k < n; ++k)
+        inverse[permutation[k]] = k;
+}
+
+// Finds the pattern of row k of L, which is the set of vertices on the paths
+// of the elimination tree from the columns of row k of A up to k. It is
+// returned in stack[top..n) in an order suitable for the triangular solve.
+int SparseCholesky::reach(int k, int mark) {
+    int top = n;
+    marks[k] = mark;
+    for (int p = lowerStart[k]; p < lowerStart[k + 1]; ++p) {
+        int i = lowerColumns[p];
+        int length = 0;
+        for (; marks[i] != mark; i = parent[i]) {
+            next[length++] = i;
+            marks[i] = mark;
+        }
+        while (length > 0)
+            stack[--top] = next[--length];
+    }
+    return top;
+}
+
+// Receives the pattern of the matrix (both triangles, with diagonal) and
+// computes the ordering, the elimination tree and the pattern of L.
+void SparseCholesky::analyze(int n, const std::vector<int> &rowStart, const std::vector<int> &columns) {
+    this->n = n;
+    order(rowStart, columns);
+
+    // Strictly lower part of the permuted matrix, row by row.
+    lowerStart.assign(n + 1, 0);
+    diagonalSource.assign(n, -1);
+    for (int k = 0; k < n; ++k) {
+        int i = permutation[k];
+        for (int p = rowStart[i]; p < rowStart[i + 1]; ++p) {
+            int j = inverse[columns[p]];
+            if (j < k)
+                lowerStart[k + 1]++;
+            else if (j == k)
+                diagonalSource[k] = p;
+        }
+    }
+    for (int k = 0; k < n; ++k)
+        lowerStart[k + 1] += lowerStart[k];
+    lowerColumns.resize(lowerStart[n]);
+    lowerSource.resize(lowerStart[n]);
+    for (int k = 0; k < n; ++k) {
+        int i = permutation[k];
+        int q = lowerStart[k];
+        for (int p = rowStart[i]; p < rowStart[i + 1]; ++p) {
+            int j = inverse[columns[p]];
+            if (j < k) {
+                lowerColumns[q] = j;
+                lowerSource[q++] = p;
+            }
+        }
+    }
+
+    // Elimination tree, with path compression through ancestor.
+    parent.assign(n, -1);
+    std::vector<int> ancestor(n, -1);
+    for (int k = 0; k < n; ++k) {
+        for (int p = lowerStart[k]; p < lowerStart[k + 1]; ++p) {
+            int i = lowerColumns[p];
+            while (i != -1 && i < k) {
+                int up = ancestor[i];
+                ancestor[i] = k;
+                if (up == -1)
+                    parent[i] = k;
+                i = up;
+            }
+        }
+    }
+
+    // Column counts of L from the row patterns.
+    stack.resize(n);
+    next.resize(n);
+    marks.assign(n, -1);
+    columnStart.assign(n + 1, 0);
+    for (int k = 0; k < n; ++k) {
+        columnStart[k + 1]++;
+        for (int top = reach(k, k); top < n; ++top)
+            columnStart[stack[top] + 1]++;
+    }
+    for (int k = 0; k < n; ++k)
+        columnStart[k + 1] += columnStart[k];
+    rows.resize(columnStart[n]);
+    values.resize(columnStart[n]);
+    work.assign(n, 0.0);
+    solution.resize(n);
+}
+
+// Computes L for the values of the analyzed pattern, row by row (up-looking):
+// row k of L comes from a sparse triangular solve with the rows above it.
+// Returns false if the matrix is not positive definite.
+bool SparseCholesky::factorize(const std::vector<double> &matrixValues) {
+    std::fill(marks.begin(), marks.end(), -1);
+    fill.assign(columnStart.begin(), columnStart.end() - 1);
+
+    for (int k = 0; k < n; ++k) {
+        int top = reach(k, k);
+        for (int p = lowerStart[k]; p < lowerStart[k + 1]; ++p)
+            work[lowerColumns[p]] = matrixValues[lowerSource[p]];
+        double d = diagonalSource[k] >= 0 ? matrixValues[diagonalSource[k]] : 0.0;
+
+        for (; top < n; ++top) {
+            int i = stack[top];
+            double lki = work[i] / values[columnStart[i]];
+            work[i] = 0.0;
+            for (int p = columnStart[i] + 1; p < fill[i]; ++p)
+                work[rows[p]] -= values[p] * lki;
+            d -= lki * lki;
+            int p = fill[i]++;
+            rows[p] = k;
+            values[p] = lki;
+        }
+        if (d <= 0.0)
+            return false;
+        int p = fill[k]++;
+        rows[p] = k;
+        values[p] = std::sqrt(d);
+    }
+    return true;
+}
+
+// Solves A x = b for three right hand sides at once, in place:
+// x = P^T L^-T L^-1 P b.
+void SparseCholesky::solve(std::vector<glm::vec3> &b) {
+    for (int k = 0; k < n; ++k)
+        solution[k] = glm::dvec3(b[permutation[k]]);
+
+    for (int j = 0; j < n; ++j) {
+        solution[j] /= values[columnStart[j]];
+        for (int p = columnStart[j] + 1; p < columnStart[j + 1]; ++p)
+            solution[rows[p]] -= values[p] * solution[j];
+    }
+    for (int j = n - 1; j >= 0; --j) {
+        for (int p = columnStart[j] + 1; p < columnStart[j + 1]; ++p)
+            solution[j] -= values[p] * solution[rows[p]];
+        solution[j] /= values[columnStart[j]];
+    }
+
+    for (int k = 0; k < n; ++k)
+        b[permutation[k]] = glm::vec3(solution[k]);
+}
+
+// Number of nonzeros of L.
+int SparseCholesky::nonZeros() {
+    return n > 0 ? columnStart[n] : 0;
+}
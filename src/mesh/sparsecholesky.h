@@ -0,0 +1,68 @@
+#ifndef SPARSECHOLESKY_H
+#define SPARSECHOLESKY_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Class responsible for the sparse Cholesky factorization A = L L^T of a
+// symmetric positive definite matrix given in compressed sparse row form.
+// The work is split like in CSparse: analyze computes a fill-reducing
+// ordering, the elimination tree and the pattern of L from the pattern of
+// A, and factorize only computes the values, so a matrix whose values change
+// but whose pattern does not is refactorized without any allocation.
+class SparseCholesky {
+    int n;
+
+    // Reverse Cuthill-McKee ordering: permutation[k] is the original row
+    // placed at position k and inverse[i] is the position of original row i.
+    std::vector<int> permutation;
+    std::vector<int> inverse;
+
+    // Strictly lower part of the permuted matrix by rows, with the index of
+    // each entry in the original values, and the index of each diagonal.
+    std::vector<int> lowerStart;
+    std::vector<int> lowerColumns;
+    std::vector<int> lowerSource;
+    std::vector<int> diagonalSource;
+
+    // Elimination tree and L by columns, diagonal first in each column.
+    std::vector<int> parent;
+    std::vector<int> columnStart;
+    std::vector<int> rows;
+    std::vector<double> values;
+
+    // Workspace of the factorization and of the solves.
+    std::vector<int> stack;
+    std::vector<int> marks;
+    std::vector<int> next;
+    std::vector<int> fill;
+    std::vector<double> work;
+    std::vector<glm::dvec3> solution;
+
+    // Computes the reverse Cuthill-McKee ordering of the pattern.
+    void order(const std::vector<int> &rowStart, const std::vector<int> &columns);
+
+    // Finds the pattern of row k of L, returned in stack[top..n) in an order
+    // suitable for the triangular solve. Returns top.
+    int reach(int k, int mark);
+
+public:
+    // Constructor responsible for creating an empty factorization.
+    SparseCholesky();
+
+    // Receives the pattern of the matrix (both triangles, with diagonal) and
+    // computes the ordering, the elimination tree and the pattern of L.
+    void analyze(int n, const std::vector<int> &rowStart, const std::vector<int> &columns);
+
+    // Computes L for the values of the analyzed pattern. Returns false if
+    // the matrix is not positive definite.
+    bool factorize(const std::vector<double> &matrixValues);
+
+    // Solves A x = b for three right hand sides at once, in place.
+    void solve(std::vector<glm::vec3> &b);
+
+    // Number of nonzeros of L.
+    int nonZeros();
+};
+
+#endif // SPARSECHOLESKY_H
@@ -0,0 +1,135 @@
+#include "springsolver.h"
+#include <algorithm>
+#include <cmath>
+
+// Constructor responsible for creating a disabled solver.
+SpringSolver::SpringSolver()
+    : stiffness(0.0f), damping(0.0f), substeps(1), integrator(SymplecticEuler) { }
+
+// Whether the solver should be used.
+bool SpringSolver::enabled() {
+    return stiffness > 0.0f;
+}
+
+// Computes the acceleration of every free particle for the current positions
+// and the given velocities. The tension of each bar is computed first, as a
+// scalar per bar, and every particle then gathers the tensions of its own
+// bars through the transposed Jacobian. Nothing is scattered, so there are
+// no write conflicts between threads.
+void SpringSolver::evaluate(std::vector<Particle> &particles, std::vector<glm::vec3> &v, glm::vec3 force,
+                            std::vector<glm::vec3> &forces) {
+    int count = static_cast<int>(restLengths.size());
+    system.fillJacobian(particles);
+
+    #pragma omp parallel for
+    for (int b = 0; b < count; ++b) {
+        glm::vec3 relative = v[system.jacobianColumns[2 * b]] - v[system.jacobianColumns[2 * b + 1]];
+        speeds[b] = glm::dot(relative, system.jacobianValues[2 * b]);
+    }
+
+    const float *lengths = system.lengths.data();
+    const float *rest = restLengths.data();
+    const float *speed = speeds.data();
+    float *tension = tensions.data();
+    #pragma omp parallel for
+    for (int b = 0; b < count; ++b)
+        tension[b] = -stiffness * (lengths[b] - rest[b]) - damping * speed[b];
+
+    system.gather(tensions, acceleration);
+    int rows = system.size();
+    #pragma omp parallel for
+    for (int r = 0; r < rows; ++r) {
+        int k = system.freeParticles[r];
+        glm::vec3 f = forces.empty() ? force : force + forces[k];
+        acceleration[r] = (f + acceleration[r]) / particles[k].mass;
+    }
+}
+
+// Advances the particles one step of size h, receiving the damping
+// coefficient, the force that acts on the mesh and the extra force of each
+// particle. The velocities are the ones implied by the Verlet positions and
+// the damping coefficient is spread over the substeps; at the end
+// previousPosition is set back so that it implies the final velocity, like
+// in the XPBD solver.
+void SpringSolver::step(std::vector<Particle> &particles, std::vector<Bar> &bars,
+                        float h, float delta, glm::vec3 force, std::vector<glm::vec3> &forces) {
+    if (system.changed(particles, bars))
+        system.analyze(particles, bars);
+
+    int size = static_cast<int>(particles.size());
+    int count = static_cast<int>(bars.size());
+    int rows = system.size();
+    int steps = std::max(substeps, 1);
+    float hs = h / steps;
+    float decay = std::pow(1.0f - delta, 1.0f / steps);
+
+    restLengths.resize(count);
+    speeds.resize(count);
+    tensions.resize(count);
+    for (int b = 0; b < count; ++b)
+        restLengths[b] = bars[b].length;
+    velocity.resize(size);
+    acceleration.resize(rows);
+
+    #pragma omp parallel for
+    for (int k = 0; k < size; ++k)
+        velocity[k] = (particles[k].position - particles[k].previousPosition) / h;
+
+    if (integrator == RungeKutta4) {
+        stageVelocity = velocity;
+        startPositions.resize(rows);
+        sumPositions.resize(rows);
+        sumVelocities.resize(rows);
+    }
+
+    for (int s = 0; s < steps; ++s) {
+        if (integrator == SymplecticEuler) {
+            evaluate(particles, velocity, force, forces);
+            #pragma omp parallel for
+            for (int r = 0; r < rows; ++r) {
+                int k = system.freeParticles[r];
+                velocity[k] = decay * (velocity[k] + hs * acceleration[r]);
+                particles[k].position += hs * velocity[k];
+            }
+            continue;
+        }
+
+        // Runge-Kutta 4: the stages are evaluated with the stage positions
+        // written into the particles, and the weighted slopes accumulated.
+        #pragma omp parallel for
+        for (int r = 0; r < rows; ++r) {
+            int k = system.freeParticles[r];
+            startPositions[r] = particles[k].position;
+            stageVelocity[k] = velocity[k];
+            sumPositions[r] = glm::vec3(0.0f);
+            sumVelocities[r] = glm::vec3(0.0f);
+        }
+        for (int stage = 0; stage < 4; ++stage) {
+            evaluate(particles, stageVelocity, force, forces);
+            float weight = stage == 0 || stage == 3 ? 1.0f : 2.0f;
+            float c = stage == 2 ? hs : 0.5f * hs;
+            #pragma omp parallel for
+            for (int r = 0; r < rows; ++r) {
+                int k = system.freeParticles[r];
+                sumPositions[r] += weight * stageVelocity[k];
+                sumVelocities[r] += weight * acceleration[r];
+                if (stage < 3) {
+                    particles[k].position = startPositions[r] + c * stageVelocity[k];
+                    stageVelocity[k] = velocity[k] + c * acceleration[r];
+                }
+            }
+        }
+        #pragma omp parallel for
+        for (int r = 0; r < rows; ++r) {
+            int k = system.freeParticles[r];
+            particles[k].position = startPositions[r] + (hs / 6.0f) * sumPositions[r];
+            velocity[k] = decay * (velocity[k] + (hs / 6.0f) * sumVelocities[r]);
+        }
+    }
+
+    #pragma omp parallel for
+    for (int r = 0; r < rows; ++r) {
+        int k = system.freeParticles[r];
+        particles[k].previousPosition = particles[k].position - h * velocity[k];
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef SPRINGSOLVER_H
+#define SPRINGSOLVER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "particle.h"
+#include "bar.h"
+#include "barsystem.h"
+
+// Class responsible for advancing a mesh as a classic force based mass-spring
+// system. Every bar is a Hookean spring of rest length Bar::length with a
+// damper along its direction, and the equations of motion are integrated
+// explicitly in substeps, with symplectic Euler or with the fourth order
+// Runge-Kutta method. Explicit springs are only stable for substeps shorter
+// than about 2 sqrt(m / k), so stiff springs need many substeps.
+class SpringSolver {
+    BarSystem system;
+
+    // Rest length, speed of elongation and tension of each bar, stored
+    // contiguously so the per bar loop is easy to vectorize.
+    std::vector<float> restLengths;
+    std::vector<float> speeds;
+    std::vector<float> tensions;
+
+    // Velocities of the particles at the start of the substep and at the
+    // current Runge-Kutta stage, with one entry per particle.
+    std::vector<glm::vec3> velocity;
+    std::vector<glm::vec3> stageVelocity;
+
+    // Accelerations, starting positions and Runge-Kutta sums of the free
+    // particles, with one entry per row of the bar system.
+    std::vector<glm::vec3> acceleration;
+    std::vector<glm::vec3> startPositions;
+    std::vector<glm::vec3> sumPositions;
+    std::vector<glm::vec3> sumVelocities;
+
+    // Computes the acceleration of every free particle for the current
+    // positions and the given velocities.
+    void evaluate(std::vector<Particle> &particles, std::vector<glm::vec3> &v, glm::vec3 force,
+                  std::vector<glm::vec3> &forces);
+
+public:
+    // Explicit integration method of each substep.
+    enum Integrator { SymplecticEuler, RungeKutta4 };
+
+    // Spring constant and damping coefficient of the bars. The solver is
+    // disabled when the stiffness is 0.
+    float stiffness;
+    float damping;
+
+    // Number of substeps per step and integration method.
+    int substeps;
+    Integrator integrator;
+
+    // Constructor responsible for creating a disabled solver.
+    SpringSolver();
+
+    // Whether the solver should be used.
+    bool enabled();
+
+    // Advances the particles one step of size h, receiving the damping
+    // coefficient, the force that acts on the mesh and the extra force of
+    // each particle, empty when there is none.
+    void step(std::vector<Particle> &particles, std::vector<Bar> &bars,
+              float h, float delta, glm::vec3 force, std::vector<glm::vec3> &forces);
+};
+
+#endif // SPRINGSOLVER_H
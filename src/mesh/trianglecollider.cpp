@@ -0,0 +1,301 @@
+#include "trianglecollider.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// Maximum number of triangles in a leaf.
+const int LEAF = 4;
+
+// Squared distance from x to the box [low, high].
+inline float boxDistance(glm::vec3 x, glm::vec3 low, glm::vec3 high) {
+    glm::vec3 d = glm::max(glm::max(low - x, x - high), glm::vec3(0.0f));
+    return glm::dot(d, d);
+}
+
+// Reads the vertex of an OBJ face corner, the number before the first
+// slash, turning relative indices into absolute ones. Returns -1 when it is
+// not valid.
+int parseCorner(const std::string &corner, int count) {
+    int index = std::atoi(corner.substr(0, corner.find('/')).c_str());
+    if (index < 0)
+        index += count;
+    else
+        index -= 1;
+    return index >= 0 && index < count ? index : -1;
+}
+
+}
+
+// Constructor responsible for creating a collider from the given vertices
+// and triangles, building its hierarchy.
+TriangleCollider::TriangleCollider(const std::vector<glm::vec3> &vertices, const std::vector<glm::ivec3> &triangles,
+                                   float friction) {
+    this->restVertices = vertices;
+    this->previousVertices = vertices;
+    this->vertices = vertices;
+    this->triangles = triangles;
+    this->friction = friction;
+
+    int count = static_cast<int>(triangles.size());
+    std::vector<glm::vec3> centroids(count);
+    order.resize(count);
+    for (int t = 0; t < count; ++t) {
+        glm::ivec3 f = triangles[t];
+        centroids[t] = (vertices[f[0]] + vertices[f[1]] + vertices[f[2]]) / 3.0f;
+        order[t] = t;
+    }
+    nodes.reserve(count > 0 ? 2 * (count / LEAF) + 1 : 0);
+    if (count > 0)
+        build(0, count, centroids);
+    refit();
+}
+
+// Builds the subtree of the triangles order[begin, end), splitting them at
+// the median centroid along the longest axis of the centroid bounds. Only
+// the layout is built here, the bounds are computed by refit.
+int TriangleCollider::build(int begin, int end, std::vector<glm::vec3> &centroids) {
+    int index = static_cast<int>(nodes.size());
+    nodes.push_back(BVHNode());
+    if (end - begin <= LEAF) {
+        nodes[index].start = begin;
+        nodes[index].count = end - begin;
+        return index;
+    }
+
+    glm::vec3 low = centroids[order[begin]], high = low;
+    for (int i = begin + 1; i < end; ++i) {
+        low = glm::min(low, centroids[order[i]]);
+        high = glm::max(high, centroids[order[i]]);
+    }
+    glm::vec3 extent = high - low;
+    int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    int middle = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                     [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+    build(begin, middle, centroids);
+    int right = build(middle, end, centroids);
+    nodes[index].start = right;
+    nodes[index].count = 0;
+    return index;
+}
+
+// Bounds of the triangles of a leaf over their motion.
+void TriangleCollider::bound(BVHNode &node) {
+    glm::vec3 low(INFINITY), high(-INFINITY);
+    for (int i = node.start; i < node.start + node.count; ++i) {
+        glm::ivec3 f = triangles[order[i]];
+        for (int j = 0; j < 3; ++j) {
+            low = glm::min(low, glm::min(vertices[f[j]], previousVertices[f[j]]));
+            high = glm::max(high, glm::max(vertices[f[j]], previousVertices[f[j]]));
+        }
+    }
+    node.low = low;
+    node.high = high;
+}
+
+// Reads the vertices and faces of a Wavefront OBJ file. Texture
+// coordinates, normals and every other statement are ignored.
+bool TriangleCollider::load(const std::string &path, std::vector<glm::vec3> &vertices,
+                            std::vector<glm::ivec3> &triangles) {
+    std::ifstream file(path.c_str());
+    if (!file)
+        return false;
+
+    vertices.clear();
+    triangles.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string type;
+        stream >> type;
+        if (type == "v") {
+            glm::vec3 v(0.0f);
+            stream >> v.x >> v.y >> v.z;
+            vertices.push_back(v);
+        } else if (type == "f") {
+            int count = static_cast<int>(vertices.size());
+            std::vector<int> corners;
+            std::string corner;
+            while (stream >> corner)
+                corners.push_back(parseCorner(corner, count));
+            if (std::find(corners.begin(), corners.end(), -1) != corners.end())
+                continue;
+            for (int i = 2; i < static_cast<int>(corners.size()); ++i)
+                triangles.push_back(glm::ivec3(corners[0], corners[i - 1], corners[i]));
+        }
+    }
+    return !triangles.empty();
+}
+
+// Moves the vertices to the rest pose transformed by the given matrix and
+// refits the hierarchy. The previous vertices are left where the last step
+// ended, so moving the collider several times between two steps sweeps the
+// whole motion and not moving it sweeps none.
+void TriangleCollider::setTransform(const glm::mat4 &transform) {
+    int count = static_cast<int>(vertices.size());
+    #pragma omp parallel for
+    for (int v = 0; v < count; ++v)
+        vertices[v] = glm::vec3(transform * glm::vec4(restVertices[v], 1.0f));
+    refit();
+}
+
+// Makes the current vertices the previous ones at the end of a step and
+// refits the hierarchy when they had moved, so the bounds stop covering a
+// motion that was already swept.
+void TriangleCollider::settle() {
+    if (previousVertices == vertices)
+        return;
+    previousVertices = vertices;
+    refit();
+}
+
+// Recomputes the bounds of every node. The leaves are independent and are
+// bounded in parallel; the inner nodes are then merged from the last to the
+// first, since the children always come after their parent.
+void TriangleCollider::refit() {
+    int count = static_cast<int>(nodes.size());
+    #pragma omp parallel for
+    for (int i = 0; i < count; ++i) {
+        if (nodes[i].count > 0)
+            bound(nodes[i]);
+    }
+    for (int i = count - 1; i >= 0; --i) {
+        BVHNode &node = nodes[i];
+        if (node.count > 0)
+            continue;
+        node.low = glm::min(nodes[i + 1].low, nodes[node.start].low);
+        node.high = glm::max(nodes[i + 1].high, nodes[node.start].high);
+    }
+}
+
+// Finds the triangle closest to x within radius. The nearer child is
+// visited first so the search radius shrinks quickly, and the distance of
+// every node is computed once, when it is pushed.
+int TriangleCollider::nearest(glm::vec3 x, float radius) {
+    float best = radius * radius;
+    if (nodes.empty() || boxDistance(x, nodes[0].low, nodes[0].high) >= best)
+        return -1;
+
+    int found = -1;
+    int stack[64];
+    float distances[64];
+    int top = 0;
+    stack[top] = 0;
+    distances[top++] = 0.0f;
+    while (top > 0) {
+        --top;
+        if (distances[top] >= best)
+            continue;
+        int index = stack[top];
+        const BVHNode &node = nodes[index];
+
+        if (node.count > 0) {
+            for (int i = node.start; i < node.start + node.count; ++i) {
+                glm::ivec3 f = triangles[order[i]];
+                glm::vec3 d = x - closestPoint(x, vertices[f[0]], vertices[f[1]], vertices[f[2]]);
+                float squared = glm::dot(d, d);
+                if (squared < best) {
+                    best = squared;
+                    found = order[i];
+                }
+            }
+            continue;
+        }
+
+        int near = index + 1;
+        int far = node.start;
+        float toNear = boxDistance(x, nodes[near].low, nodes[near].high);
+        float toFar = boxDistance(x, nodes[far].low, nodes[far].high);
+        if (toFar < toNear) {
+            std::swap(near, far);
+            std::swap(toNear, toFar);
+        }
+        if (toFar < best) {
+            stack[top] = far;
+            distances[top++] = toFar;
+        }
+        if (toNear < best) {
+            stack[top] = near;
+            distances[top++] = toNear;
+        }
+    }
+    return found;
+}
+
+// Collects in found the triangles whose swept bounds overlap the box
+// [low, high].
+void TriangleCollider::overlapping(glm::vec3 low, glm::vec3 high, std::vector<int> &found) {
+    found.clear();
+    if (nodes.empty())
+        return;
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        int index = stack[--top];
+        const BVHNode &node = nodes[index];
+        if (glm::any(glm::lessThan(high, node.low)) || glm::any(glm::greaterThan(low, node.high)))
+            continue;
+        if (node.count > 0) {
+            for (int i = node.start; i < node.start + node.count; ++i)
+                found.push_back(order[i]);
+            continue;
+        }
+        stack[top++] = node.start;
+        stack[top++] = index + 1;
+    }
+}
+
+// Point of triangle t closest to x.
+glm::vec3 TriangleCollider::closest(int t, glm::vec3 x) {
+    glm::ivec3 f = triangles[t];
+    return closestPoint(x, vertices[f[0]], vertices[f[1]], vertices[f[2]]);
+}
+
+// Unit normal of triangle t, or zero when the triangle is degenerate.
+glm::vec3 TriangleCollider::normal(int t) {
+    glm::ivec3 f = triangles[t];
+    glm::vec3 n = glm::cross(vertices[f[1]] - vertices[f[0]], vertices[f[2]] - vertices[f[0]]);
+    float length = glm::length(n);
+    return length > 0.0f ? n / length : glm::vec3(0.0f);
+}
+
+// Point of the triangle abc closest to p, walking its Voronoi regions
+// (Ericson, Real-Time Collision Detection, 5.1.5).
+glm::vec3 TriangleCollider::closestPoint(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + (d1 / (d1 - d3)) * ab;
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + (d2 / (d2 - d6)) * ac;
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+
+    float denominator = 1.0f / (va + vb + vc);
+    return a + (vb * denominator) * ab + (vc * denominator) * ac;
+}
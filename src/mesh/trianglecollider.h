@@ -0,0 +1,91 @@
+#ifndef TRIANGLECOLLIDER_H
+#define TRIANGLECOLLIDER_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Node of the bounding volume hierarchy of a triangle collider. A leaf holds
+// count triangles starting at start in the leaf order; an inner node has
+// count 0, its left child right after it and its right child at start, so
+// the children always come after their parent.
+struct BVHNode {
+    glm::vec3 low;
+    int start;
+    glm::vec3 high;
+    int count;
+};
+
+// Class that represents a collider made of triangles, static or animated.
+// The hierarchy is built once, splitting the triangles at the median of the
+// longest axis of their centroids, and only refit when the vertices move, so
+// animating the collider costs a pass over the nodes and the quality of the
+// tree depends on the animation not tearing apart triangles that were close
+// in the rest pose. The bounds cover the motion of every triangle from its
+// previous vertices to its current ones, so the same tree serves the
+// continuous collision queries.
+class TriangleCollider {
+    std::vector<BVHNode> nodes;
+
+    // Triangles in the order of the leaves.
+    std::vector<int> order;
+
+    // Builds the subtree of the triangles order[begin, end) and returns its
+    // node.
+    int build(int begin, int end, std::vector<glm::vec3> &centroids);
+
+    // Bounds of the triangles of a leaf.
+    void bound(BVHNode &node);
+
+public:
+    // Vertices in the rest pose, at the end of the last step, current
+    // vertices and triangles.
+    std::vector<glm::vec3> restVertices;
+    std::vector<glm::vec3> previousVertices;
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::ivec3> triangles;
+
+    float friction;
+
+    // Constructor responsible for creating a collider from the given
+    // vertices and triangles, building its hierarchy.
+    TriangleCollider(const std::vector<glm::vec3> &vertices, const std::vector<glm::ivec3> &triangles,
+                     float friction = 0.0f);
+
+    // Reads the vertices and faces of a Wavefront OBJ file, splitting
+    // polygons in fans of triangles. Returns false when the file cannot be
+    // read or has no faces.
+    static bool load(const std::string &path, std::vector<glm::vec3> &vertices, std::vector<glm::ivec3> &triangles);
+
+    // Moves the vertices to the rest pose transformed by the given matrix
+    // and refits the hierarchy. The previous vertices keep the pose of the
+    // end of the last step.
+    void setTransform(const glm::mat4 &transform);
+
+    // Makes the current vertices the previous ones, once a step swept the
+    // particles against their motion, and refits the hierarchy if they moved.
+    void settle();
+
+    // Recomputes the bounds of every node for the previous and current
+    // vertices. Must be called after editing them.
+    void refit();
+
+    // Finds the triangle closest to x among those within radius of it.
+    // Returns -1 when there is none.
+    int nearest(glm::vec3 x, float radius);
+
+    // Collects in found the triangles whose swept bounds overlap the box
+    // [low, high].
+    void overlapping(glm::vec3 low, glm::vec3 high, std::vector<int> &found);
+
+    // Point of triangle t closest to x.
+    glm::vec3 closest(int t, glm::vec3 x);
+
+    // Point of the triangle abc closest to p.
+    static glm::vec3 closestPoint(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c);
+
+    // Unit normal of triangle t, following the order of its vertices.
+    glm::vec3 normal(int t);
+};
+
+#endif // TRIANGLECOLLIDER_H
@@ -13,9 +13,19 @@
 
 RenderWidget::RenderWidget(QWidget *parent)
     : QOpenGLWidget(parent),
-      mesh(RectangularMesh(30, 20, 0.2f, 1.f, 20, 0.05, 0.02, glm::vec3(0.0f), glm::vec3(0.0f))),
+      mesh(scene.add<RectangularMesh>(30, 20, 0.2f, 1.f, 20, 0.05, 0.02, glm::vec3(0.0f), glm::vec3(0.0f))),
+      levelOfDetail(1),
       program(nullptr) {
 
+    // Wind: a mean breeze whose gusts sweep across the cloth, plus
+    // turbulence carried along with it
+    mesh.field.wind = glm::vec3(5.0f, 6.0f, -2.0f);
+    mesh.field.gustStrength = 0.6f;
+    mesh.field.gustPeriod = 3.0f;
+    mesh.field.gustSpeed = 10.0f;
+    mesh.field.createTurbulence(32, 2.0f, 4.0f);
+    mesh.field.turbulenceVelocity = glm::vec3(5.0f, 0.0f, -2.0f);
+
     connect(&timer, SIGNAL(timeout()), this, SLOT(update()));
     if(format().swapInterval() == -1)
     {
@@ -139,7 +149,8 @@ void RenderWidget::paintGL()
     program.setUniformValue("mv_ti", mv.inverted().transposed());
     program.setUniformValue("mvp", mvp);
 
-    // Update mesh and draw
+    // Choose the level of detail, update mesh and draw
+    setLevelOfDetail(chooseLevelOfDetail());
     updateMesh();
 //    glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
     glDrawElements(GL_TRIANGLES, static_cast<int>(indices.size()), GL_UNSIGNED_INT, nullptr);
@@ -225,80 +236,183 @@ void RenderWidget::rotate(glm::ivec2 p1, glm::ivec2 p2)
 
 void RenderWidget::createMesh()
 {
-    int n = mesh.n, m = mesh.m;
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < m; ++j) {
-            vertices.push_back(mesh.particles[i][j].position);
+    embedding.create(mesh.n, mesh.m, levelOfDetail);
+    int rows = embedding.rows, columns = embedding.columns;
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < columns; ++j) {
+            vertices.push_back(embedding.position(mesh.particles, i, j));
         }
     }
 
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < m; ++j) {
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < columns; ++j) {
             normals.push_back(glm::vec3(0.0f, 0.0f, 1.0f));
         }
     }
 
-    for (int i = 0; i < n-1; ++i) {
-        for (int j = 0; j < m-1; ++j) {
-            int k = i*m + j;
+    for (int i = 0; i < rows-1; ++i) {
+        for (int j = 0; j < columns-1; ++j) {
+            int k = i*columns + j;
             indices.push_back(k);
-            indices.push_back(k+m+1);
-            indices.push_back(k+m);
+            indices.push_back(k+columns+1);
+            indices.push_back(k+columns);
 
             indices.push_back(k);
             indices.push_back(k+1);
-            indices.push_back(k+m+1);
+            indices.push_back(k+columns+1);
         }
     }
 }
 
-void RenderWidget::updateMesh()
+int RenderWidget::chooseLevelOfDetail()
+{
+    // Project the bounding box of the cloth with the same matrices used to
+    // draw it and measure how many pixels a cell of the simulated mesh
+    // covers on screen. Close cloth gets a refined render grid, distant
+    // cloth is drawn with the simulated particles only
+    glm::vec3 low = mesh.particles[0].position, high = low;
+    for (auto &particle : mesh.particles) {
+        if (!particle.isActive)
+            continue;
+        low = glm::min(low, particle.position);
+        high = glm::max(high, particle.position);
+    }
+
+    glm::mat4 mvp = proj * view * glm::scale(glm::vec3(.2f)) * model;
+    glm::vec2 screenLow(1e30f), screenHigh(-1e30f);
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 p((corner & 1) ? high.x : low.x, (corner & 2) ? high.y : low.y, (corner & 4) ? high.z : low.z);
+        glm::vec4 clip = mvp * glm::vec4(p, 1.0f);
+        if (clip.w <= 0.0f)
+            return 4;
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        screenLow = glm::min(screenLow, ndc);
+        screenHigh = glm::max(screenHigh, ndc);
+    }
+
+    glm::vec2 pixels = 0.5f * (screenHigh - screenLow) * glm::vec2(width(), height());
+    float cell = std::max(pixels.x, pixels.y) / (std::max(mesh.n, mesh.m) - 1);
+
+    // Refine past the upper threshold of the next level but coarsen only
+    // below a lower one, so a cloth hovering around a threshold does not
+    // rebuild its render grid every frame
+    const float refine[] = {12.0f, 32.0f};
+    const float coarsen[] = {9.0f, 24.0f};
+    int level = levelOfDetail == 4 ? 2 : levelOfDetail == 2 ? 1 : 0;
+    while (level < 2 && cell > refine[level])
+        ++level;
+    while (level > 0 && cell < coarsen[level - 1])
+        --level;
+    return 1 << level;
+}
+
+void RenderWidget::setLevelOfDetail(int factor)
 {
-    QTime time = QTime::currentTime();
-    float sin_t = glm::sin(0.5*time.msecsSinceStartOfDay());
+    if (factor == levelOfDetail)
+        return;
+    levelOfDetail = factor;
+
+    vertices.clear();
+    normals.clear();
+    indices.clear();
+    createMesh();
+
+    vbo.clear();
+    for (unsigned int i = 0; i < vertices.size(); i++)
+        vbo.push_back({vertices[i], normals[i]});
+    updateNormals(0, embedding.rows);
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vbo.size() * sizeof(vertex), &vbo[0], GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_DYNAMIC_DRAW);
+}
 
+void RenderWidget::updateMesh()
+{
+    // The wind comes from the force field of the mesh, sampled per particle
     glm::vec3 gravity = glm::vec3(0.0f, -9.8f, 0.0f);
-    glm::vec3 wind = glm::vec3(5.0f + 2.0f*sin_t, 6.0f + 6.0f*sin_t, -2.0f+sin_t);
-    mesh.setForce(gravity+wind);
-    mesh.oneStep();
+    mesh.setForce(gravity);
+    scene.step();
+
+    // Only the rows that may have moved since the last frame are evaluated,
+    // get their normals recomputed and are uploaded, in contiguous ranges.
+    // Each row of the simulated mesh moves the render rows of the cells
+    // around it, and normals also depend on the neighbouring rows, so each
+    // range grows on both sides. Nothing is uploaded when the cloth is static.
+    // Without refinement the render vertices are the particles, so the
+    // normals the mesh computes are used as they are, and the aerodynamics
+    // of the next step reuse them.
+    int n = mesh.n, columns = embedding.columns;
+    bool shared = embedding.factor == 1;
+    if (shared && mesh.rowsMoved(0, n))
+        mesh.updateNormals();
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    for (int begin = 0; begin < n; ) {
+        if (!mesh.rowsMoved(begin, begin + 1)) {
+            ++begin;
+            continue;
+        }
+        int end = begin + 1;
+        while (end < n && mesh.rowsMoved(end, end + 1))
+            ++end;
+
+        int first, last;
+        embedding.fineRows(begin, end, first, last);
+        #pragma omp parallel for
+        for (int i = first; i < last; ++i) {
+            for (int j = 0; j < columns; ++j) {
+                vbo[i*columns + j].pos = embedding.position(mesh.particles, i, j);
+            }
+        }
 
-    int n = mesh.n, m = mesh.m;
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < m; ++j) {
-            int k = i*m + j;
-            vbo[k].pos = mesh.particles[i][j].position;
-            vbo[k].normal = glm::vec3(0.0f);
+        first = std::max(first - 1, 0);
+        last = std::min(last + 1, embedding.rows);
+        if (shared) {
+            for (int k = first*columns; k < last*columns; ++k) {
+                vbo[k].normal = mesh.normals[k];
+            }
+        } else {
+            updateNormals(first, last);
         }
+        glBufferSubData(GL_ARRAY_BUFFER, first * columns * sizeof(vertex), (last - first) * columns * sizeof(vertex),
+                        &vbo[first*columns]);
+        begin = end;
+    }
+}
+
+void RenderWidget::updateNormals(int begin, int end)
+{
+    // Recompute the normals of the rows [begin, end) from the quads around them
+    int n = embedding.rows, m = embedding.columns;
+    for (int k = begin*m; k < end*m; ++k) {
+        vbo[k].normal = glm::vec3(0.0f);
     }
 
-    for (int i = 0; i < n-1; ++i) {
+    for (int i = std::max(begin - 1, 0); i < std::min(end, n-1); ++i) {
         for (int j = 0; j < m-1; ++j) {
             int k = i*m + j;
             glm::vec3 v1 = vbo[k+1].pos - vbo[k].pos;
             glm::vec3 v2 = vbo[k+m+1].pos - vbo[k].pos;
             glm::vec3 n1 = glm::cross(v1, v2);
-            vbo[k].normal += n1;
-            vbo[k+1].normal += n1;
-            vbo[k+m+1].normal += n1;
 
             glm::vec3 v3 = vbo[k+m].pos - vbo[k].pos;
             glm::vec3 n2 = glm::cross(v2, v3);
-            vbo[k].normal += n2;
-            vbo[k+m+1].normal += n2;
-            vbo[k+m].normal += n2;
-        }
-    }
 
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < m; ++j) {
-            int k = i*m + j;
-            vbo[k].normal = glm::normalize(vbo[k].normal);
+            if (i >= begin) {
+                vbo[k].normal += n1 + n2;
+                vbo[k+1].normal += n1;
+            }
+            if (i + 1 < end) {
+                vbo[k+m+1].normal += n1 + n2;
+                vbo[k+m].normal += n2;
+            }
         }
     }
 
-    void *ptr = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-    memcpy(ptr, &vbo[0], vbo.size() * sizeof(vertex));
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+    for (int k = begin*m; k < end*m; ++k) {
+        vbo[k].normal = glm::normalize(vbo[k].normal);
+    }
 }
 
 void RenderWidget::createVBO()
@@ -13,6 +13,8 @@
 
 #include "glm/glm.hpp"
 #include "mesh/rectangularmesh.h"
+#include "mesh/embedding.h"
+#include "mesh/scene.h"
 
 class RenderWidget
         : public QOpenGLWidget
@@ -42,8 +44,14 @@ private:
     glm::vec3 center;
     glm::vec3 up;
 
-    // Mesh
-    RectangularMesh mesh;
+    // Scene and the mesh of it that is drawn
+    Scene scene;
+    RectangularMesh &mesh;
+
+    // Level of detail: the render grid refines each cell of the simulated
+    // mesh levelOfDetail times in each direction
+    Embedding embedding;
+    int levelOfDetail;
 
     // Arcball
     int radius;
@@ -58,6 +66,9 @@ private:
     // Mesh and vertex functions
     void createMesh();
     void updateMesh();
+    void updateNormals(int begin, int end);
+    int chooseLevelOfDetail();
+    void setLevelOfDetail(int factor);
     void createVBO();
     void createTexture(const std::string& imagePath);
 